@@ -9,6 +9,9 @@
 #include "quickmozview.h"
 #include "qmozcontext.h"
 #include "qmozscrolldecorator.h"
+#include "qmozobserver.h"
+#include "qmozjsonpayload.h"
+#include "qmozmessagelistener.h"
 #include "qmlmozcontext.h"
 
 class QtMozEmbedPlugin : public QQmlExtensionPlugin
@@ -23,6 +26,9 @@ public:
         qmlRegisterType<QuickMozView>("Qt5Mozilla", 1, 0, "QmlMozView");
         qmlRegisterType<QmlMozContext>("Qt5Mozilla", 1, 0, "QmlMozContext");
         qmlRegisterUncreatableType<QMozScrollDecorator>("Qt5Mozilla", 1, 0, "QmlMozScrollDecorator", "");
+        qmlRegisterType<QMozObserver>("Qt5Mozilla", 1, 0, "MozObserver");
+        qmlRegisterUncreatableType<QMozJsonPayload>("Qt5Mozilla", 1, 0, "MozJsonPayload", "");
+        qmlRegisterType<QMozMessageListener>("Qt5Mozilla", 1, 0, "MozMessageListener");
         setenv("EMBED_COMPONENTS_PATH", DEFAULT_COMPONENTS_PATH, 1);
     }
 };
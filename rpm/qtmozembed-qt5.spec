@@ -56,6 +56,7 @@ This package contains QML unit tests for QtMozEmbed library
 %defattr(-,root,root,-)
 %{_libdir}/*.so.*
 %{_libdir}/qt5/qml/Qt5Mozilla/*
+%{_datadir}/qtmozembed/*
 
 %files devel
 %defattr(-,root,root,-)
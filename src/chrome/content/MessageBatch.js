@@ -0,0 +1,81 @@
+/* -*- Mode: JavaScript; tab-width: 2; indent-tabs-mode: nil; js-indent-level: 2 -*- */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+"use strict";
+
+/*
+ * Unpacks "embed:batch" messages sent by QuickMozView::sendAsyncMessages()
+ * into the messages they carry. Views load it when they are initialized,
+ * before the frame scripts embedders load: listeners added after it see
+ * batched messages exactly like single ones. Listeners added before it,
+ * by scripts EmbedLite loads itself, are out of its reach: entries no
+ * known listener takes go back as "embed:batch-unhandled", the view
+ * sends them and later messages of that name unbatched. Loading it again
+ * is a no-op.
+ */
+
+(function(global) {
+  if (global._embedMessageBatch) {
+    return;
+  }
+
+  let listeners = {};
+  let addListener = global.addMessageListener;
+  let removeListener = global.removeMessageListener;
+
+  global.addMessageListener = function(aName, aListener) {
+    (listeners[aName] = listeners[aName] || []).push(aListener);
+    addListener.call(global, aName, aListener);
+  };
+
+  global.removeMessageListener = function(aName, aListener) {
+    let list = listeners[aName];
+    let index = list ? list.indexOf(aListener) : -1;
+    if (index >= 0) {
+      list.splice(index, 1);
+    }
+    removeListener.call(global, aName, aListener);
+  };
+
+  global._embedMessageBatch = {
+    receiveMessage: function(aMessage) {
+      let batch = aMessage.json;
+      if (!Array.isArray(batch)) {
+        return;
+      }
+      let unhandled = [];
+      batch.forEach(function(aEntry) {
+        let name = aEntry[0];
+        if (!listeners[name] || !listeners[name].length) {
+          unhandled.push(aEntry);
+          return;
+        }
+        let message = {
+          name: name,
+          json: aEntry[1],
+          data: aEntry[1],
+          target: aMessage.target,
+          sync: false
+        };
+        // A copy, receivers may remove themselves
+        (listeners[name] || []).slice().forEach(function(aListener) {
+          try {
+            if (typeof aListener == "function") {
+              aListener(message);
+            } else {
+              aListener.receiveMessage(message);
+            }
+          } catch (e) {
+            dump("MessageBatch.js: " + name + " listener failed: " + e + "\n");
+          }
+        });
+      });
+      if (unhandled.length) {
+        global.sendAsyncMessage("embed:batch-unhandled", unhandled);
+      }
+    }
+  };
+
+  addListener.call(global, "embed:batch", global._embedMessageBatch);
+})(this);
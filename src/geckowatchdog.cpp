@@ -0,0 +1,131 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-*/
+/* vim: set ts=4 sw=4 et tw=79: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <QDateTime>
+#include <QMutexLocker>
+
+#include "geckowatchdog.h"
+
+GeckoWatchdog::GeckoWatchdog(int aThreshold, QObject* parent)
+    : QThread(parent)
+    , mThreshold(aThreshold)
+    , mStop(0)
+    , mPhase(NULL)
+    , mPhaseStart(0)
+    , mPhaseSequence(0)
+    , mNestedReported(false)
+    , mRingNext(0)
+    , mRingCount(0)
+{
+    mClock.start();
+}
+
+GeckoWatchdog::~GeckoWatchdog()
+{
+    mStop.store(1);
+    wait();
+}
+
+void GeckoWatchdog::setThreshold(int aThreshold)
+{
+    mThreshold.store(aThreshold);
+}
+
+void GeckoWatchdog::run()
+{
+    int reportedSequence = -1;
+    while (!mStop.load()) {
+        int threshold = mThreshold.load();
+        msleep(qMax(threshold / 2, 10));
+
+        int sequence = mPhaseSequence.load();
+        const char* phase = mPhase.load();
+        if (!phase || sequence == reportedSequence) {
+            continue;
+        }
+        int blocked = now() - mPhaseStart.load();
+        if (blocked > threshold && sequence == mPhaseSequence.load()) {
+            reportedSequence = sequence;
+            qWarning("GeckoWatchdog: %s blocking the Gecko/Qt thread for %d ms", phase, blocked);
+            // Queued to receivers on the blocked thread, they see it
+            // once it recovers, recentLongTasks() right away
+            reportLongTask(phase, blocked, true);
+        }
+    }
+}
+
+void GeckoWatchdog::reportLongTask(const char* aPhase, int aDuration, bool aStuck)
+{
+    {
+        QMutexLocker locker(&mRingMutex);
+        LongTask& task = mRing[mRingNext];
+        task.phase = aPhase;
+        task.durationMs = aDuration;
+        task.timestamp = QDateTime::currentMSecsSinceEpoch();
+        task.stuck = aStuck;
+        mRingNext = (mRingNext + 1) % RingSize;
+        mRingCount = qMin(mRingCount + 1, int(RingSize));
+    }
+    Q_EMIT longTaskDetected(QString::fromLatin1(aPhase), aDuration);
+}
+
+QVariantList GeckoWatchdog::recentLongTasks() const
+{
+    QMutexLocker locker(&mRingMutex);
+    QVariantList tasks;
+    int first = (mRingNext - mRingCount + RingSize) % RingSize;
+    for (int i = 0; i < mRingCount; ++i) {
+        const LongTask& task = mRing[(first + i) % RingSize];
+        QVariantMap entry;
+        entry.insert("phase", QString::fromLatin1(task.phase));
+        entry.insert("durationMs", task.durationMs);
+        entry.insert("timestamp", task.timestamp);
+        entry.insert("stuck", task.stuck);
+        tasks.append(entry);
+    }
+    return tasks;
+}
+
+GeckoWatchdogScope::GeckoWatchdogScope(GeckoWatchdog* aWatchdog, const char* aPhase)
+    : mWatchdog(aWatchdog)
+    , mPhase(aPhase)
+    , mPreviousPhase(NULL)
+    , mPreviousStart(0)
+    , mPreviousReported(false)
+    , mStart(0)
+{
+    if (!mWatchdog) {
+        return;
+    }
+    mStart = mWatchdog->now();
+    mPreviousPhase = mWatchdog->mPhase.load();
+    mPreviousStart = mWatchdog->mPhaseStart.load();
+    mPreviousReported = mWatchdog->mNestedReported;
+    mWatchdog->mNestedReported = false;
+    mWatchdog->mPhaseStart.store(mStart);
+    mWatchdog->mPhase.store(mPhase);
+    mWatchdog->mPhaseSequence.ref();
+}
+
+GeckoWatchdogScope::~GeckoWatchdogScope()
+{
+    if (!mWatchdog) {
+        return;
+    }
+    int duration = mWatchdog->now() - mStart;
+    // Restore the enclosing phase, the watchdog thread keeps timing it
+    // from its original start
+    mWatchdog->mPhaseStart.store(mPreviousStart);
+    mWatchdog->mPhase.store(mPreviousPhase);
+    mWatchdog->mPhaseSequence.ref();
+    // A long nested phase already accounts for this one
+    bool reported = mWatchdog->mNestedReported;
+    if (!reported && duration > mWatchdog->threshold()) {
+        mWatchdog->reportLongTask(mPhase, duration, false);
+        reported = true;
+    }
+    mWatchdog->mNestedReported = mPreviousReported || reported;
+}
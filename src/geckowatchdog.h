@@ -0,0 +1,103 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-*/
+/* vim: set ts=4 sw=4 et tw=79: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef GECKOWATCHDOG_H
+#define GECKOWATCHDOG_H
+
+#include <QThread>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QElapsedTimer>
+#include <QVariant>
+
+/*!
+ * Watches the thread shared by Gecko and Qt for long running tasks.
+ *
+ * Code running on the monitored thread marks its phase with a
+ * GeckoWatchdogScope. When a phase takes longer than the threshold,
+ * longTaskDetected() is emitted as the phase ends and the task is kept
+ * in a small ring buffer. The watchdog thread checks for phases that are
+ * still stuck and reports them the same way while they block, so a hang
+ * that never returns is visible too.
+ */
+class GeckoWatchdog : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit GeckoWatchdog(int aThreshold, QObject* parent = 0);
+    virtual ~GeckoWatchdog();
+
+    void setThreshold(int aThreshold);
+    int threshold() const { return mThreshold.load(); }
+
+    // Most recent long tasks, oldest first, as maps with "phase",
+    // "durationMs", "timestamp" (ms since epoch) and "stuck", true when
+    // reported while the phase was still blocking
+    QVariantList recentLongTasks() const;
+
+Q_SIGNALS:
+    // Emitted on the monitored thread when a long phase has finished, and
+    // on the watchdog thread once while a phase is stuck. A phase that
+    // gets stuck and then returns is reported both ways.
+    void longTaskDetected(const QString& phase, int durationMs);
+
+protected:
+    virtual void run();
+
+private:
+    friend class GeckoWatchdogScope;
+
+    struct LongTask {
+        const char* phase;
+        int durationMs;
+        qint64 timestamp;
+        bool stuck;
+    };
+    enum { RingSize = 32 };
+
+    int now() const { return int(mClock.elapsed()); }
+    void reportLongTask(const char* aPhase, int aDuration, bool aStuck);
+
+    QElapsedTimer mClock;
+    QAtomicInt mThreshold;
+    QAtomicInt mStop;
+    // Innermost phase running on the monitored thread, NULL when idle
+    QAtomicPointer<const char> mPhase;
+    QAtomicInt mPhaseStart;
+    QAtomicInt mPhaseSequence;
+    // A scope nested in the current one has reported itself, only
+    // touched on the monitored thread
+    bool mNestedReported;
+
+    mutable QMutex mRingMutex;
+    LongTask mRing[RingSize];
+    int mRingNext;
+    int mRingCount;
+};
+
+/*!
+ * Marks the enclosed code as phase aPhase, which must be a string literal.
+ * Scopes nest; only the innermost long one is reported, enclosing scopes
+ * are not reported again. A NULL watchdog is a no-op.
+ */
+class GeckoWatchdogScope
+{
+public:
+    GeckoWatchdogScope(GeckoWatchdog* aWatchdog, const char* aPhase);
+    ~GeckoWatchdogScope();
+
+private:
+    GeckoWatchdog* mWatchdog;
+    const char* mPhase;
+    const char* mPreviousPhase;
+    int mPreviousStart;
+    bool mPreviousReported;
+    int mStart;
+};
+
+#endif
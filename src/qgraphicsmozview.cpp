@@ -22,6 +22,7 @@
 #include "mozilla/embedlite/EmbedLiteApp.h"
 
 #include "qgraphicsmozview_p.h"
+#include "qmozjsonpayload.h"
 
 using namespace mozilla;
 using namespace mozilla::embedlite;
@@ -85,7 +86,8 @@ void
 QGraphicsMozView::onInitialized()
 {
     LOGT("mParentID:%u", mParentID);
-    if (!d->mView) {
+    if (!d->mView && d->mContext->GetApp()) {
+        d->mContext->recordStartupPhase(QStringLiteral("createView"));
         d->mView = d->mContext->GetApp()->CreateView(mParentID);
         d->mView->SetListener(d);
     }
@@ -181,23 +183,23 @@ void QGraphicsMozView::loadFrameScript(const QString& name)
 
 void QGraphicsMozView::addMessageListener(const QString& name)
 {
-    if (!d->mViewInitialized)
-        return;
-
     LOGT("name:%s", name.toUtf8().data());
-    d->mView->AddMessageListener(name.toUtf8().data());
+    d->AddMessageListeners(QStringList() << name);
 }
 
 void QGraphicsMozView::addMessageListeners(const QStringList& messageNamesList)
 {
-    if (!d->mViewInitialized)
-        return;
+    d->AddMessageListeners(messageNamesList);
+}
 
-    nsTArray<nsString> messages;
-    for (int i = 0; i < messageNamesList.size(); i++) {
-        messages.AppendElement((char16_t*)messageNamesList.at(i).data());
-    }
-    d->mView->AddMessageListeners(messages);
+int QGraphicsMozView::registerMessageHandler(const QString& message, const QMozMessageHandler& handler)
+{
+    return d->RegisterMessageHandler(message, handler);
+}
+
+void QGraphicsMozView::unregisterMessageHandler(int id)
+{
+    d->UnregisterMessageHandler(id);
 }
 
 void QGraphicsMozView::sendAsyncMessage(const QString& name, const QVariant& variant)
@@ -205,10 +207,13 @@ void QGraphicsMozView::sendAsyncMessage(const QString& name, const QVariant& var
     if (!d->mViewInitialized)
         return;
 
-    QJsonDocument doc = QJsonDocument::fromVariant(variant);
-    QByteArray array = doc.toJson();
+    const QString& data = d->mContext->serializeMessage(variant);
+    d->mView->SendAsyncMessage((const char16_t*)name.constData(), (const char16_t*)data.constData());
+}
 
-    d->mView->SendAsyncMessage((const char16_t*)name.constData(), NS_ConvertUTF8toUTF16(array.constData()).get());
+void QGraphicsMozView::sendAsyncMessages(const QVariantList& messages)
+{
+    d->SendAsyncMessages(messages);
 }
 
 QPointF QGraphicsMozView::scrollableOffset() const
@@ -14,6 +14,7 @@
 class QMozContext;
 class QSyncMessage;
 class QGraphicsMozViewPrivate;
+template<class TMozQView> class IMozQView;
 
 class QGraphicsMozView : public QGraphicsWidget
 {
@@ -48,6 +49,7 @@ public Q_SLOTS:
     void reload();
     void load(const QString&);
     void sendAsyncMessage(const QString& name, const QVariant& variant);
+    void sendAsyncMessages(const QVariantList& messages);
     void addMessageListener(const QString& name);
     void addMessageListeners(const QStringList& messageNamesList);
     void loadFrameScript(const QString& name);
@@ -75,7 +77,9 @@ Q_SIGNALS:
     void loadingChanged();
     void viewDestroyed();
     void recvAsyncMessage(const QString message, const QVariant data);
+    void recvAsyncMessagePayload(const QString message, QMozJsonPayload* payload);
     bool recvSyncMessage(const QString message, const QVariant data, QMozReturnValue* response);
+    void recvSyncMessagePayload(const QString message, QMozJsonPayload* payload, QMozReturnValue* response);
     void loadRedirect();
     void securityChanged(QString status, uint state);
     void firstPaint(int offx, int offy);
@@ -121,6 +125,7 @@ private Q_SLOTS:
 
 private:
     QGraphicsMozViewPrivate* d;
+    friend class IMozQView<QGraphicsMozView>;
     unsigned mParentID;
 
     bool mUseQmlMouse;
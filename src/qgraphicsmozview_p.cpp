@@ -7,11 +7,14 @@
 #define LOG_COMPONENT "QGraphicsMozViewPrivate"
 
 #include <QTouchEvent>
-#include <QJsonDocument>
 #include <QGuiApplication>
+#include <QElapsedTimer>
 
 #include "qgraphicsmozview_p.h"
 #include "qmozcontext.h"
+#include "qmozjsonpayload.h"
+#include "qmozpayloaddecoder.h"
+#include "geckowatchdog.h"
 #include "InputData.h"
 #include "mozilla/embedlite/EmbedLiteApp.h"
 #include "mozilla/gfx/Tools.h"
@@ -24,6 +27,12 @@
 #endif
 
 #define SCROLL_EPSILON 0.001
+// Message name MessageBatch.js listens to
+#define MOZVIEW_MESSAGE_BATCH "embed:batch"
+// Entries MessageBatch.js sends back for lack of a listener it knows
+#define MOZVIEW_MESSAGE_BATCH_UNHANDLED "embed:batch-unhandled"
+// Registered by QMozContext through QtMozEmbed.manifest
+#define MOZVIEW_MESSAGE_BATCH_SCRIPT "chrome://qtmozembed/content/MessageBatch.js"
 
 using namespace mozilla;
 using namespace mozilla::embedlite;
@@ -79,11 +88,16 @@ QGraphicsMozViewPrivate::QGraphicsMozViewPrivate(IMozQViewIface* aViewIface)
     , mPressed(false)
     , mDragging(false)
     , mFlicking(false)
+    , mNextMessageHandlerId(1)
 {
 }
 
 QGraphicsMozViewPrivate::~QGraphicsMozViewPrivate()
 {
+    if (mContext) {
+        mContext->payloadDecoder()->cancel(this);
+        mContext->unregisterView(mViewIface->viewObject());
+    }
     delete mViewIface;
 }
 
@@ -221,6 +235,113 @@ void QGraphicsMozViewPrivate::UpdateMoving(bool moving)
     }
 }
 
+void QGraphicsMozViewPrivate::AddMessageListeners(const QStringList& aNames)
+{
+    if (!mViewInitialized) {
+        mPendingMessageListeners.append(aNames);
+        return;
+    }
+
+    nsTArray<nsString> messages;
+    for (int i = 0; i < aNames.size(); i++) {
+        messages.AppendElement((char16_t*)aNames.at(i).data());
+    }
+    mView->AddMessageListeners(messages);
+}
+
+void QGraphicsMozViewPrivate::SendAsyncMessages(const QVariantList& aMessages)
+{
+    if (!mViewInitialized || aMessages.isEmpty()) {
+        return;
+    }
+
+    // Unbatched names split the batch, posting order is kept
+    QVariantList batch;
+    Q_FOREACH (const QVariant& message, aMessages) {
+        const QString name = message.toMap().value(QStringLiteral("name")).toString();
+        if (mUnbatchedMessages.contains(name)) {
+            SendMessageBatch(batch);
+            batch.clear();
+            SendMessageBatch(QVariantList() << message);
+        } else {
+            batch.append(message);
+        }
+    }
+    SendMessageBatch(batch);
+}
+
+void QGraphicsMozViewPrivate::SendMessageBatch(const QVariantList& aMessages)
+{
+    if (aMessages.isEmpty()) {
+        return;
+    }
+
+    if (aMessages.size() == 1) {
+        // Nothing to save, no need for MessageBatch.js on the other side
+        const QVariantMap message = aMessages.first().toMap();
+        const QString name = message.value(QStringLiteral("name")).toString();
+        if (!name.isEmpty()) {
+            const QString& data = mContext->serializeMessage(message.value(QStringLiteral("data")));
+            mView->SendAsyncMessage((const char16_t*)name.constData(), (const char16_t*)data.constData());
+        }
+        return;
+    }
+
+    // One serialization and one crossing, unpacked by MessageBatch.js
+    static const QString batchName = QStringLiteral(MOZVIEW_MESSAGE_BATCH);
+    const QString& data = mContext->serializeMessageBatch(aMessages);
+    LOGT("batch of %i messages, %i chars", aMessages.size(), data.size());
+    mView->SendAsyncMessage((const char16_t*)batchName.constData(), (const char16_t*)data.constData());
+}
+
+void QGraphicsMozViewPrivate::ResendUnbatched(QMozJsonPayload* aPayload)
+{
+    // [[name, data], ...] in the order they were batched
+    Q_FOREACH (const QVariant& entry, aPayload->toVariant().toList()) {
+        const QVariantList pair = entry.toList();
+        const QString name = pair.value(0).toString();
+        if (name.isEmpty()) {
+            continue;
+        }
+        LOGT("no batch listener for %s, sending it unbatched", name.toUtf8().data());
+        mUnbatchedMessages.insert(name);
+        const QString& data = mContext->serializeMessage(pair.value(1));
+        mView->SendAsyncMessage((const char16_t*)name.constData(), (const char16_t*)data.constData());
+    }
+}
+
+int QGraphicsMozViewPrivate::RegisterMessageHandler(const QString& aMessage, const QMozMessageHandler& aHandler)
+{
+    MessageHandlerEntry entry = { mNextMessageHandlerId++, aHandler };
+    QList<MessageHandlerEntry>& handlers = mMessageHandlers[aMessage];
+    if (handlers.isEmpty()) {
+        AddMessageListeners(QStringList() << aMessage);
+    }
+    handlers.append(entry);
+    mMessageHandlerNames.insert(entry.id, aMessage);
+    return entry.id;
+}
+
+void QGraphicsMozViewPrivate::UnregisterMessageHandler(int aId)
+{
+    QHash<int, QString>::iterator name = mMessageHandlerNames.find(aId);
+    if (name == mMessageHandlerNames.end()) {
+        return;
+    }
+    QList<MessageHandlerEntry>& handlers = mMessageHandlers[*name];
+    for (int i = 0; i < handlers.size(); ++i) {
+        if (handlers.at(i).id == aId) {
+            handlers.removeAt(i);
+            break;
+        }
+    }
+    // Content keeps sending the message, it is dropped undecoded
+    if (handlers.isEmpty()) {
+        mMessageHandlers.remove(*name);
+    }
+    mMessageHandlerNames.erase(name);
+}
+
 void QGraphicsMozViewPrivate::UpdateViewSize()
 {
     if (mSize.isEmpty())
@@ -253,6 +374,16 @@ void QGraphicsMozViewPrivate::ViewInitialized()
 {
     mViewInitialized = true;
     UpdateViewSize();
+    if (!mPendingMessageListeners.isEmpty()) {
+        AddMessageListeners(mPendingMessageListeners);
+        mPendingMessageListeners.clear();
+    }
+    // Ahead of the frame scripts embedders load from viewInitialized(),
+    // it wraps addMessageListener() so their listeners get batched messages
+    mView->LoadFrameScript(MOZVIEW_MESSAGE_BATCH_SCRIPT);
+    AddMessageListeners(QStringList() << QStringLiteral(MOZVIEW_MESSAGE_BATCH_UNHANDLED));
+    mContext->registerView(mViewIface->viewObject(), mView);
+    mContext->recordStartupPhase(QString("viewInitialized:%1").arg(mView->GetUniqueID()));
     // This is currently part of official API, so let's subscribe to these messages by default
     mViewIface->viewInitialized();
     mViewIface->navigationHistoryChanged();
@@ -325,6 +456,7 @@ void QGraphicsMozViewPrivate::OnWindowCloseRequested()
 void QGraphicsMozViewPrivate::ViewDestroyed()
 {
     LOGT();
+    mContext->unregisterView(mViewIface->viewObject());
     mView = NULL;
     mViewInitialized = false;
     mViewIface->viewDestroyed();
@@ -332,42 +464,85 @@ void QGraphicsMozViewPrivate::ViewDestroyed()
 
 void QGraphicsMozViewPrivate::RecvAsyncMessage(const char16_t* aMessage, const char16_t* aData)
 {
-    NS_ConvertUTF16toUTF8 message(aMessage);
-    NS_ConvertUTF16toUTF8 data(aData);
+    GeckoWatchdogScope phase(mContext->longTaskWatchdog(), "RecvAsyncMessage");
+    QString message((QChar*)aMessage);
+    if (message == QLatin1String(MOZVIEW_MESSAGE_BATCH_UNHANDLED)) {
+        QMozJsonPayload payload(QString((QChar*)aData));
+        ResendUnbatched(&payload);
+        return;
+    }
 
-    bool ok = false;
-    QJsonParseError error;
-    QJsonDocument doc = QJsonDocument::fromJson(QByteArray(data.get()), &error);
-    ok = error.error == QJsonParseError::NoError;
-    QVariant vdata = doc.toVariant();
+    // Copy, handlers may register or unregister while being called
+    QList<MessageHandlerEntry> handlers = mMessageHandlers.value(message);
+    bool broadcast = mViewIface->hasAsyncMessageReceivers();
+    bool payloadBroadcast = mViewIface->hasAsyncMessagePayloadReceivers();
+    if (handlers.isEmpty() && !broadcast && !payloadBroadcast) {
+        return;
+    }
 
-    if (ok) {
-        LOGT("mesg:%s, data:%s", message.get(), data.get());
-        mViewIface->recvAsyncMessage(message.get(), vdata);
-    } else {
-        LOGT("parse: err:%s, errLine:%i", error.errorString().toUtf8().data(), error.offset);
+    // Parsed on demand, payload handlers may read single fields only
+    QMozJsonPayload payload(QString((QChar*)aData));
+    Q_FOREACH (const MessageHandlerEntry& entry, handlers) {
+        entry.handler(message, &payload);
+    }
+    if (payloadBroadcast) {
+        mViewIface->recvAsyncMessagePayload(message, &payload);
+    }
+    if (broadcast) {
+        // Large payloads are parsed off the GUI thread, delivered in order per view
+        mContext->payloadDecoder()->decode(this, QString(), payload, [this, message](const QVariant& aData, bool aOk) {
+            if (aOk) {
+                LOGT("mesg:%s", message.toUtf8().data());
+                mViewIface->recvAsyncMessage(message, aData);
+            }
+        });
     }
 }
 
 char* QGraphicsMozViewPrivate::RecvSyncMessage(const char16_t* aMessage, const char16_t*  aData)
 {
-    QMozReturnValue response;
-    NS_ConvertUTF16toUTF8 message(aMessage);
-    NS_ConvertUTF16toUTF8 data(aData);
-
-    bool ok = false;
-    QJsonParseError error;
-    QJsonDocument doc = QJsonDocument::fromJson(QByteArray(data.get()), &error);
-    ok = error.error == QJsonParseError::NoError;
-    QVariant vdata = doc.toVariant();
-
-    mViewIface->recvSyncMessage(message.get(), vdata, &response);
-
-    QJsonDocument respdoc = QJsonDocument::fromVariant(response.getMessage());
-    QByteArray array = respdoc.toJson();
+    GeckoWatchdogScope phase(mContext->longTaskWatchdog(), "RecvSyncMessage");
+    // Content scripts are blocked until we return
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    // Deferring handlers may keep the reply object beyond this call
+    QMozReturnValue* response = new QMozReturnValue();
+    QString message((QChar*)aMessage);
+
+    QMozJsonPayload payload(QString((QChar*)aData));
+    mViewIface->recvSyncMessagePayload(message, &payload, response);
+    if (mViewIface->hasSyncMessageReceivers()) {
+        mViewIface->recvSyncMessage(message, payload.toVariant(), response);
+    }
+
+    // Reply handed to Gecko, the default one on timeout
+    QMozReturnValue fallback;
+    const QMozReturnValue* answer = response;
+    // No nested event loop here: it would run QML, deleteLater() and
+    // Gecko's own UI loop from inside this Gecko callback. Deferred
+    // replies are answered from other threads while we block.
+    int deadline = mContext->syncMessageDeadline();
+    if (response->deferred() && !response->waitForAnswer(qMax(deadline - int(elapsed.elapsed()), 0))) {
+        fallback.setMessage(mContext->syncMessageDefaultReply());
+        answer = &fallback;
+        LOGT("msg:%s, no reply within %i ms", message.toUtf8().data(), deadline);
+        Q_EMIT mContext->syncMessageTimedOut(message, deadline);
+    }
+
+    char* reply;
+    if (answer->replyType() == QMozReturnValue::VariantReply && !answer->getMessage().isValid()) {
+        reply = strdup("");
+    } else {
+        const QByteArray& array = mContext->serializeReplyUtf8(*answer);
+        LOGT("msg:%s, response:%s", message.toUtf8().data(), array.constData());
+        reply = strdup(array.constData());
+    }
+    // A handler that did not answer in time still holds it
+    response->release();
 
-    LOGT("msg:%s, response:%s", message.get(), array.constData());
-    return strdup(array.constData());
+    mContext->recordSyncMessageLatency(message, elapsed.nsecsElapsed() / 1000);
+    return reply;
 }
 
 void QGraphicsMozViewPrivate::OnLoadRedirect(void)
@@ -384,6 +559,9 @@ void QGraphicsMozViewPrivate::OnSecurityChanged(const char* aStatus, unsigned in
 void QGraphicsMozViewPrivate::OnFirstPaint(int32_t aX, int32_t aY)
 {
     LOGT();
+    if (!mIsPainted && mView) {
+        mContext->recordStartupPhase(QString("firstPaint:%1").arg(mView->GetUniqueID()));
+    }
     mIsPainted = true;
     mViewIface->firstPaint(aX, aY);
 }
@@ -14,6 +14,9 @@
 #include <QString>
 #include <QPointF>
 #include <QMap>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
 #include <QSGSimpleTextureNode>
 #include "qmozscrolldecorator.h"
 #include "mozilla/embedlite/EmbedLiteView.h"
@@ -24,6 +27,11 @@ class QGraphicsView;
 class QTouchEvent;
 class QMozContext;
 
+struct MessageHandlerEntry {
+    int id;
+    QMozMessageHandler handler;
+};
+
 class QGraphicsMozViewPrivate : public mozilla::embedlite::EmbedLiteViewListener
 {
 public:
@@ -75,6 +83,14 @@ public:
     void HandleTouchEnd(bool& draggingChanged, bool& pinchingChanged);
     void ResetState();
     void UpdateMoving(bool moving);
+    // Subscribes to messages from content, queued until the view is initialized
+    void AddMessageListeners(const QStringList& aNames);
+    int RegisterMessageHandler(const QString& aMessage, const QMozMessageHandler& aHandler);
+    void UnregisterMessageHandler(int aId);
+    void SendAsyncMessages(const QVariantList& aMessages);
+    void SendMessageBatch(const QVariantList& aMessages);
+    // Sends entries MessageBatch.js had no listener for one by one
+    void ResendUnbatched(QMozJsonPayload* aPayload);
 
     IMozQViewIface* mViewIface;
     QMozContext* mContext;
@@ -124,6 +140,13 @@ public:
     bool mPressed;
     bool mDragging;
     bool mFlicking;
+    // Async messages are routed to the handlers of their name
+    QHash<QString, QList<MessageHandlerEntry> > mMessageHandlers;
+    QHash<int, QString> mMessageHandlerNames;
+    int mNextMessageHandlerId;
+    QStringList mPendingMessageListeners;
+    // Names whose listeners MessageBatch.js does not see, never batched
+    QSet<QString> mUnbatchedMessages;
 };
 
 qint64 current_timestamp(QTouchEvent*);
@@ -9,10 +9,23 @@
 #include <QTimer>
 #include <QEvent>
 #include <QThread>
+#include <QElapsedTimer>
 #include <QAbstractEventDispatcher>
+#include <QSocketNotifier>
 #include <QGuiApplication>
+#include <QTimerEvent>
+#include <QtQuick/QQuickWindow>
+#include <string.h>
 
+#ifdef Q_OS_LINUX
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
+#include "qmozembedlog.h"
 #include "qmessagepump.h"
+#include "geckowatchdog.h"
 
 #include "mozilla/embedlite/EmbedLiteMessagePump.h"
 #include "mozilla/embedlite/EmbedLiteApp.h"
@@ -22,30 +35,122 @@ using namespace mozilla::embedlite;
 namespace {
 // Cached QEvent user type, registered for our event system
 static int sPokeEvent;
+// Run deferred idle work anyway when no frame was swapped for this long,
+// a static scene does not render at all.
+static const int sIdleFallbackTimeout = 50;
+// A frame gap is over after one 60Hz frame interval
+static const int sFrameInterval = 16;
 }  // namespace
 
-MessagePumpQt::MessagePumpQt(EmbedLiteApp* aApp)
-  : mApp(aApp), mTimer(new QTimer(this)), state_(0), mLastDelayedWorkTime(-1)
+MessagePumpQt::MessagePumpQt(EmbedLiteApp* aApp, Backend aBackend)
+  : mApp(aApp), mTimer(new QTimer(this)), mBackend(aBackend)
+  , mWakeupFd(-1), mTimerFd(-1), mWakeupNotifier(NULL), mTimerNotifier(NULL)
+  , state_(0), mRunDepth(0), mLastDelayedWorkTime(-1)
+  , mBackground(false), mTimerSlack(0), mArmedExpiry(-1), mDelayedWorkRescheduled(false)
+  , mCoalescePokes(true), mDispatchBudget(0)
+  , mIdleBudgetPerFrame(0), mIdleSpentThisFrame(0), mIdleDeferred(false)
+  , mIdleFallbackTimerId(0), mDeferredIdleSlices(0)
+  , mPrioritizeInput(false), mStarvationLimit(100), mInteractive(false)
+  , mHighPriorityPending(0), mLowPriorityPoke(0), mLastDispatchTime(-1), mInputYields(0)
+  , mDelayedWorkDeadline(-1), mDoWorkCalls(0), mDoDelayedWorkCalls(0), mDoIdleWorkCalls(0)
+  , mOutstandingPokes(0), mWatchdog(NULL)
+  , mPokePending(0), mCoalescedPokes(0)
 {
+  mClock.start();
   mEventLoopPrivate = mApp->CreateEmbedLiteMessagePump(this);
   // Register our custom event type, to use in qApp event loop
   sPokeEvent = QEvent::registerEventType();
   connect(mTimer, SIGNAL(timeout()), this, SLOT(dispatchDelayed()));
   mTimer->setSingleShot(true);
+  mTimer->setTimerType(Qt::PreciseTimer);
+
+  if (mBackend == EventFdBackend && !setupFdBackend()) {
+    LOGT("eventfd backend not available, falling back to posted events");
+    mBackend = PostEventBackend;
+  }
 }
 
 MessagePumpQt::~MessagePumpQt()
 {
   mTimer->stop();
   delete mTimer;
-  delete state_;
+  delete mWakeupNotifier;
+  delete mTimerNotifier;
+#ifdef Q_OS_LINUX
+  if (mWakeupFd >= 0) {
+    close(mWakeupFd);
+  }
+  if (mTimerFd >= 0) {
+    close(mTimerFd);
+  }
+#endif
   delete mEventLoopPrivate;
 }
 
+bool
+MessagePumpQt::setupFdBackend()
+{
+#ifdef Q_OS_LINUX
+  mWakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  mTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (mWakeupFd < 0 || mTimerFd < 0) {
+    if (mWakeupFd >= 0) {
+      close(mWakeupFd);
+    }
+    if (mTimerFd >= 0) {
+      close(mTimerFd);
+    }
+    mWakeupFd = mTimerFd = -1;
+    return false;
+  }
+
+  // Notifiers attach to the event dispatcher of the thread owning the pump
+  mWakeupNotifier = new QSocketNotifier(mWakeupFd, QSocketNotifier::Read, this);
+  connect(mWakeupNotifier, SIGNAL(activated(int)), this, SLOT(wakeupFdActivated()));
+  mTimerNotifier = new QSocketNotifier(mTimerFd, QSocketNotifier::Read, this);
+  connect(mTimerNotifier, SIGNAL(activated(int)), this, SLOT(timerFdActivated()));
+  return true;
+#else
+  return false;
+#endif
+}
+
+void
+MessagePumpQt::wakeupFdActivated()
+{
+#ifdef Q_OS_LINUX
+  eventfd_t value;
+  // Drain the counter, all wakeups up to here are served by this dispatch
+  if (eventfd_read(mWakeupFd, &value) == 0) {
+    mOutstandingPokes.fetchAndAddOrdered(-int(value));
+  }
+#endif
+  mPokePending.store(0);
+  HandleDispatch();
+}
+
+void
+MessagePumpQt::timerFdActivated()
+{
+#ifdef Q_OS_LINUX
+  uint64_t expirations;
+  if (read(mTimerFd, &expirations, sizeof(expirations)) < 0) {
+    // Timer was re-armed after the notification, nothing expired yet
+    return;
+  }
+#endif
+  dispatchDelayed();
+}
+
 bool
 MessagePumpQt::event(QEvent *e)
 {
   if (e->type() == sPokeEvent) {
+    // Clear the flag before dispatching so that work scheduled from
+    // within DoWork() posts a fresh poke
+    mPokePending.store(0);
+    mLowPriorityPoke.store(0);
+    mOutstandingPokes.deref();
     HandleDispatch();
     return true;
   }
@@ -54,71 +159,439 @@ MessagePumpQt::event(QEvent *e)
 
 void MessagePumpQt::HandleDispatch()
 {
-  if (state_->should_quit) {
+  if (!state_ || state_->should_quit) {
     return;
   }
+  // Quit() pops state_, keep watching the state this dispatch runs for
+  RunState* state = state_;
 
-  if (mEventLoopPrivate->DoWork(state_->delegate)) {
-    // there might be more, see more_work_is_plausible 
-    // variable above, that's why we ScheduleWork() to keep going.
-    ScheduleWorkLocal();
+  bool starving = isStarving();
+  mLastDispatchTime.store(mClock.nsecsElapsed());
+  // Low priority pokes are only delivered after Qt has flushed the normal
+  // priority events posted before, so whatever was pending has been served.
+  mHighPriorityPending.store(0);
+
+  QElapsedTimer budget;
+  if (mDispatchBudget) {
+    budget.start();
   }
 
-  if (state_->should_quit) {
-    return;
+  bool moreWork = false;
+  do {
+    moreWork = doWork();
+    if (state->should_quit) {
+      return;
+    }
+    if (moreWork && !starving && shouldYieldToInput()) {
+      mInputYields++;
+      break;
+    }
+  } while (moreWork && mDispatchBudget && !budget.hasExpired(mDispatchBudget));
+
+  if (moreWork) {
+    // there might be more, see more_work_is_plausible
+    // variable above, that's why we ScheduleWork() to keep going.
+    ScheduleWorkLocal();
   }
 
-  bool doIdleWork = !mEventLoopPrivate->DoDelayedWork(state_->delegate);
+  bool doIdleWork = !doDelayedWork();
   scheduleDelayedIfNeeded();
 
   if (doIdleWork) {
-    if (mEventLoopPrivate->DoIdleWork(state_->delegate)) {
-      ScheduleWorkLocal();
+    if (mayRunIdleWork()) {
+      if (!runIdleWork() && !moreWork) {
+        Q_EMIT idle();
+      }
+    } else if (!mIdleDeferred) {
+      mIdleDeferred = true;
+      mDeferredIdleSlices++;
+      mIdleFallbackTimerId = startTimer(sIdleFallbackTimeout);
     }
   }
 }
 
+bool
+MessagePumpQt::doWork()
+{
+  qint64 start = mClock.nsecsElapsed();
+  bool result;
+  {
+    GeckoWatchdogScope phase(mWatchdog, "DoWork");
+    result = mEventLoopPrivate->DoWork(state_->delegate);
+  }
+  mDoWorkCalls++;
+  mDoWorkTime.add((mClock.nsecsElapsed() - start) / 1000);
+  return result;
+}
+
+bool
+MessagePumpQt::doDelayedWork()
+{
+  qint64 start = mClock.nsecsElapsed();
+  bool due = mDelayedWorkDeadline >= 0 && start >= mDelayedWorkDeadline;
+  if (due) {
+    mDelayedWorkLateness.add((start - mDelayedWorkDeadline) / 1000);
+    mDelayedWorkDeadline = -1;
+    mArmedExpiry = -1;
+  }
+  mDelayedWorkRescheduled = false;
+  bool result;
+  {
+    GeckoWatchdogScope phase(mWatchdog, "DoDelayedWork");
+    result = mEventLoopPrivate->DoDelayedWork(state_->delegate);
+  }
+  if (due && !mDelayedWorkRescheduled && mLastDelayedWorkTime >= 0) {
+    // Gecko did not ask for a new deadline, keep polling at the last
+    // requested interval as before
+    mDelayedWorkDeadline = mClock.nsecsElapsed() + mLastDelayedWorkTime * Q_INT64_C(1000000);
+  }
+  mDoDelayedWorkCalls++;
+  mDoDelayedWorkTime.add((mClock.nsecsElapsed() - start) / 1000);
+  return result;
+}
+
+bool
+MessagePumpQt::doIdleWork()
+{
+  qint64 start = mClock.nsecsElapsed();
+  bool result;
+  {
+    GeckoWatchdogScope phase(mWatchdog, "DoIdleWork");
+    result = mEventLoopPrivate->DoIdleWork(state_->delegate);
+  }
+  mDoIdleWorkCalls++;
+  mDoIdleWorkTime.add((mClock.nsecsElapsed() - start) / 1000);
+  return result;
+}
+
+QVariantMap
+MessagePumpQt::statistics() const
+{
+  QVariantMap stats;
+  stats.insert("doWorkCalls", mDoWorkCalls);
+  stats.insert("doDelayedWorkCalls", mDoDelayedWorkCalls);
+  stats.insert("doIdleWorkCalls", mDoIdleWorkCalls);
+  stats.insert("doWorkTime", mDoWorkTime.toVariantMap());
+  stats.insert("doDelayedWorkTime", mDoDelayedWorkTime.toVariantMap());
+  stats.insert("doIdleWorkTime", mDoIdleWorkTime.toVariantMap());
+  stats.insert("delayedWorkLateness", mDelayedWorkLateness.toVariantMap());
+  stats.insert("outstandingPokes", mOutstandingPokes.load());
+  stats.insert("coalescedPokes", mCoalescedPokes.load());
+  stats.insert("deferredIdleSlices", mDeferredIdleSlices);
+  stats.insert("inputYields", mInputYields);
+  return stats;
+}
+
+void
+MessagePumpQt::resetStatistics()
+{
+  mDoWorkCalls = mDoDelayedWorkCalls = mDoIdleWorkCalls = 0;
+  mDoWorkTime.reset();
+  mDoDelayedWorkTime.reset();
+  mDoIdleWorkTime.reset();
+  mDelayedWorkLateness.reset();
+  mCoalescedPokes.store(0);
+  mDeferredIdleSlices = 0;
+  mInputYields = 0;
+}
+
+void
+PumpHistogram::add(qint64 aUsec)
+{
+  int bucket = 0;
+  while (bucket < BucketCount - 1 && aUsec >= (Q_INT64_C(1) << bucket)) {
+    bucket++;
+  }
+  mBuckets[bucket]++;
+  mCount++;
+  mTotal += aUsec;
+  mMax = qMax(mMax, aUsec);
+}
+
+void
+PumpHistogram::reset()
+{
+  memset(mBuckets, 0, sizeof(mBuckets));
+  mCount = 0;
+  mTotal = 0;
+  mMax = 0;
+}
+
+QVariantMap
+PumpHistogram::toVariantMap() const
+{
+  QVariantList buckets;
+  for (int i = 0; i < BucketCount; ++i) {
+    buckets.append(mBuckets[i]);
+  }
+  QVariantMap map;
+  // Upper bound of bucket i is 2^i microseconds
+  map.insert("buckets", buckets);
+  map.insert("count", mCount);
+  map.insert("totalUs", mTotal);
+  map.insert("maxUs", mMax);
+  return map;
+}
+
+bool
+MessagePumpQt::shouldYieldToInput()
+{
+  return mPrioritizeInput.load() && (mInteractive.load() || mHighPriorityPending.load());
+}
+
+bool
+MessagePumpQt::isStarving() const
+{
+  qint64 lastDispatch = mLastDispatchTime.load();
+  return lastDispatch >= 0 &&
+         mClock.nsecsElapsed() - lastDispatch > mStarvationLimit.load() * Q_INT64_C(1000000);
+}
+
+void
+MessagePumpQt::setPrioritizeInput(bool aEnabled, int aStarvationLimit)
+{
+  mStarvationLimit.store(aStarvationLimit > 0 ? aStarvationLimit : 0);
+  if (bool(mPrioritizeInput.load()) == aEnabled) {
+    return;
+  }
+  mPrioritizeInput.store(aEnabled);
+  mInteractive.store(0);
+  if (!QCoreApplication::instance()) {
+    return;
+  }
+  if (aEnabled) {
+    QCoreApplication::instance()->installEventFilter(this);
+  } else {
+    QCoreApplication::instance()->removeEventFilter(this);
+  }
+}
+
+bool
+MessagePumpQt::eventFilter(QObject* aObject, QEvent* aEvent)
+{
+  switch (aEvent->type()) {
+  case QEvent::TouchBegin:
+  case QEvent::TouchUpdate:
+  case QEvent::KeyPress:
+    mInteractive.store(1);
+    break;
+  case QEvent::TouchEnd:
+  case QEvent::TouchCancel:
+  case QEvent::KeyRelease:
+    mInteractive.store(0);
+    break;
+  default:
+    break;
+  }
+  return QObject::eventFilter(aObject, aEvent);
+}
+
+bool
+MessagePumpQt::runIdleWork()
+{
+  QElapsedTimer spent;
+  spent.start();
+  bool moreIdleWork = doIdleWork();
+  // Idle slices are mostly well below a millisecond, keep them in usec
+  mIdleSpentThisFrame += spent.nsecsElapsed() / 1000;
+  if (moreIdleWork) {
+    ScheduleWorkLocal();
+  }
+  return moreIdleWork;
+}
+
+bool
+MessagePumpQt::mayRunIdleWork()
+{
+  if (!mIdleFrameWindow || !mIdleBudgetPerFrame) {
+    return true;
+  }
+  return mFrameGap.isValid() && !mFrameGap.hasExpired(sFrameInterval) &&
+         mIdleSpentThisFrame < mIdleBudgetPerFrame * Q_INT64_C(1000);
+}
+
+void
+MessagePumpQt::setIdleFrameWindow(QQuickWindow* aWindow)
+{
+  if (mIdleFrameWindow == aWindow) {
+    return;
+  }
+  if (mIdleFrameWindow) {
+    disconnect(mIdleFrameWindow, SIGNAL(frameSwapped()), this, SLOT(frameSwapped()));
+  }
+  mIdleFrameWindow = aWindow;
+  mFrameGap.invalidate();
+  if (mIdleFrameWindow) {
+    // Emitted from the scene graph render thread, handled on the pump thread
+    connect(mIdleFrameWindow, SIGNAL(frameSwapped()), this, SLOT(frameSwapped()));
+  }
+}
+
+void
+MessagePumpQt::frameSwapped()
+{
+  mFrameGap.start();
+  mIdleSpentThisFrame = 0;
+  if (mIdleDeferred) {
+    mIdleDeferred = false;
+    killTimer(mIdleFallbackTimerId);
+    mIdleFallbackTimerId = 0;
+    ScheduleWorkLocal();
+  }
+}
+
+void
+MessagePumpQt::timerEvent(QTimerEvent* aEvent)
+{
+  if (aEvent->timerId() == mIdleFallbackTimerId) {
+    // Nothing is being rendered, treat it as an open frame gap
+    frameSwapped();
+    return;
+  }
+  QObject::timerEvent(aEvent);
+}
+
 void MessagePumpQt::ScheduleWorkLocal()
 {
+  // Starving bulk work is queued at normal priority so that a steady
+  // stream of input can not hold it back forever
+  bool starving = isStarving();
+  if (mCoalescePokes.load() && !mPokePending.testAndSetOrdered(0, 1)) {
+    // A low priority poke absorbs all later calls, promote it once it
+    // has waited too long by queueing a normal priority one next to it
+    if (!starving || !mLowPriorityPoke.testAndSetOrdered(1, 0)) {
+      mCoalescedPokes.ref();
+      return;
+    }
+  }
+  mOutstandingPokes.ref();
+#ifdef Q_OS_LINUX
+  // Socket notifier activations can not be given a priority, input
+  // priority mode falls back to posted pokes
+  if (mBackend == EventFdBackend && !mPrioritizeInput.load()) {
+    eventfd_write(mWakeupFd, 1);
+    return;
+  }
+#endif
+  bool lowPriority = mPrioritizeInput.load() && !starving;
+  if (lowPriority) {
+    mLowPriorityPoke.store(1);
+  }
   QCoreApplication::postEvent(this,
-                              new QEvent((QEvent::Type)sPokeEvent));
+                              new QEvent((QEvent::Type)sPokeEvent),
+                              lowPriority ? Qt::LowEventPriority : Qt::NormalEventPriority);
 }
 
 void
 MessagePumpQt::scheduleDelayedIfNeeded()
 {
-  if (mLastDelayedWorkTime == -1) {
+  if (mDelayedWorkDeadline < 0) {
+    if (mArmedExpiry >= 0) {
+      mArmedExpiry = -1;
+      mTimer->stop();
+#ifdef Q_OS_LINUX
+      if (mBackend == EventFdBackend) {
+        struct itimerspec disarm = {};
+        timerfd_settime(mTimerFd, 0, &disarm, NULL);
+      }
+#endif
+    }
     return;
   }
 
-  if (mTimer->isActive()) {
-    mTimer->stop();
+  qint64 expiry = mDelayedWorkDeadline;
+  if (mBackground && mTimerSlack > 0) {
+    // Align to the slack grid so that wakeups of nearby deadlines coincide
+    qint64 slack = mTimerSlack * Q_INT64_C(1000000);
+    expiry = ((expiry + slack - 1) / slack) * slack;
+  }
+  if (expiry == mArmedExpiry) {
+    // Already armed for this deadline, restarting would only push it out
+    return;
+  }
+  mArmedExpiry = expiry;
+  qint64 remaining = qMax(expiry - mClock.nsecsElapsed(), Q_INT64_C(0));
+
+#ifdef Q_OS_LINUX
+  if (mBackend == EventFdBackend) {
+    // Zero it_value disarms the timer, use the smallest expiry instead
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec = remaining / 1000000000;
+    spec.it_value.tv_nsec = remaining % 1000000000;
+    if (!spec.it_value.tv_sec && !spec.it_value.tv_nsec) {
+      spec.it_value.tv_nsec = 1;
+    }
+    timerfd_settime(mTimerFd, 0, &spec, NULL);
+    return;
   }
+#endif
+
+  // QTimer has millisecond resolution, never fire before the deadline
+  mTimer->start(int((remaining + 999999) / 1000000));
+}
 
-  mTimer->start(mLastDelayedWorkTime >= 0 ? mLastDelayedWorkTime : 0);
+void
+MessagePumpQt::setBackground(bool aBackground, int aSlack)
+{
+  mTimerSlack = aSlack > 0 ? aSlack : 0;
+  if (mBackground == aBackground) {
+    return;
+  }
+  mBackground = aBackground;
+  mTimer->setTimerType(mBackground ? Qt::CoarseTimer : Qt::PreciseTimer);
+  // Re-arm under the new policy
+  mArmedExpiry = -1;
+  scheduleDelayedIfNeeded();
 }
 
 void
 MessagePumpQt::dispatchDelayed()
 {
+  // Single shot, nothing is armed any more. Coarse timers may fire a bit
+  // early, in which case the dispatch below re-arms for the same deadline.
+  mArmedExpiry = -1;
   HandleDispatch();
 }
 
 void MessagePumpQt::Run(void* delegate)
 {
-  RunState* state = new RunState();
+  mRunDepth++;
+  if (mRunDepth > MaxRunDepth) {
+    // Keep dispatching for the innermost state we could store, the
+    // matching Quit() calls unwind the overflow first
+    Q_ASSERT_X(false, "MessagePumpQt::Run", "nested run loops too deep");
+    qWarning("MessagePumpQt: nested Run() depth %d exceeds %d", mRunDepth, int(MaxRunDepth));
+    HandleDispatch();
+    return;
+  }
+
+  RunState* state = &mRunStates[mRunDepth - 1];
   state->delegate = delegate;
   state->should_quit = false;
-  state->run_depth = state_ ? state_->run_depth + 1 : 1;
+  state->run_depth = mRunDepth;
   state_ = state;
   HandleDispatch();
 }
 
 void MessagePumpQt::Quit()
 {
-  if (state_) {
-    state_->should_quit = true;
-    state_->delegate = NULL;
+  if (!mRunDepth) {
+    return;
+  }
+
+  mRunDepth--;
+  if (mRunDepth >= MaxRunDepth) {
+    return;
+  }
+
+  mRunStates[mRunDepth].should_quit = true;
+  mRunStates[mRunDepth].delegate = NULL;
+  if (mRunDepth) {
+    // Back to the enclosing loop, which may have work left
+    state_ = &mRunStates[mRunDepth - 1];
+    ScheduleWorkLocal();
+  } else {
+    state_ = NULL;
   }
 }
 
@@ -129,6 +602,8 @@ void MessagePumpQt::ScheduleWork()
 
 void MessagePumpQt::ScheduleDelayedWork(const int aDelay)
 {
+  mDelayedWorkDeadline = aDelay >= 0 ? mClock.nsecsElapsed() + aDelay * Q_INT64_C(1000000) : -1;
   mLastDelayedWorkTime = aDelay;
+  mDelayedWorkRescheduled = true;
   scheduleDelayedIfNeeded();
 }
@@ -9,6 +9,9 @@
 
 #include <QObject>
 #include <QTimer>
+#include <QAtomicInt>
+#include <QPointer>
+#include <QElapsedTimer>
 #include <QVariant>
 #include <QStringList>
 #include "mozilla/embedlite/EmbedLiteMessagePump.h"
@@ -18,12 +21,45 @@ namespace embedlite {
 class EmbedLiteApp;
 }}
 
+class QSocketNotifier;
+class QQuickWindow;
+class GeckoWatchdog;
+
+// Log2 histogram of durations in microseconds: bucket i counts samples
+// below 2^i us, the last bucket collects everything longer.
+class PumpHistogram
+{
+public:
+  enum { BucketCount = 18 };
+
+  PumpHistogram() { reset(); }
+
+  void add(qint64 aUsec);
+  void reset();
+  QVariantMap toVariantMap() const;
+
+private:
+  quint32 mBuckets[BucketCount];
+  quint32 mCount;
+  qint64 mTotal;
+  qint64 mMax;
+};
+
 class MessagePumpQt : public QObject, public mozilla::embedlite::EmbedLiteMessagePumpListener
 {
   Q_OBJECT
 
 public:
-  MessagePumpQt(mozilla::embedlite::EmbedLiteApp* aApp);
+  enum Backend {
+    // Wake up through posted QEvents, delayed work through a QTimer
+    PostEventBackend,
+    // Wake up through an eventfd, delayed work through a timerfd, both
+    // watched by QSocketNotifiers of the thread's event dispatcher.
+    // Falls back to PostEventBackend where not available.
+    EventFdBackend
+  };
+
+  MessagePumpQt(mozilla::embedlite::EmbedLiteApp* aApp, Backend aBackend = PostEventBackend);
   ~MessagePumpQt();
 
   virtual bool event(QEvent* e);
@@ -37,11 +73,91 @@ public:
   virtual void ScheduleDelayedWork(const int aDelay);
 
   mozilla::embedlite::EmbedLiteMessagePump* EmbedLoop() { return mEventLoopPrivate; }
+  Backend backend() const { return mBackend; }
+
+  // When enabled (default) at most one poke event is queued at any time,
+  // extra ScheduleWork() calls are folded into the pending one.
+  void setCoalescePokes(bool aEnabled) { mCoalescePokes.store(aEnabled); }
+  bool coalescePokes() const { return mCoalescePokes.load(); }
+  // Number of ScheduleWork() calls folded into an already queued poke
+  int coalescedPokes() const { return mCoalescedPokes.load(); }
+
+  // Keep calling DoWork() within one dispatch until aMsec milliseconds
+  // have been spent, then yield to the Qt event loop. 0 runs a single
+  // DoWork() per dispatch.
+  void setDispatchBudget(int aMsec) { mDispatchBudget = aMsec > 0 ? aMsec : 0; }
+  int dispatchBudget() const { return mDispatchBudget; }
+
+  // Frame aware idle work, off by default: when a window and a non-zero
+  // setIdleBudgetPerFrame() are set, DoIdleWork() only runs in the gap
+  // after the window has swapped a frame and for at most that many
+  // milliseconds per frame. Otherwise idle work runs whenever there is
+  // nothing else to do.
+  void setIdleFrameWindow(QQuickWindow* aWindow);
+  void setIdleBudgetPerFrame(int aMsec) { mIdleBudgetPerFrame = aMsec > 0 ? aMsec : 0; }
+  int idleBudgetPerFrame() const { return mIdleBudgetPerFrame; }
+  // Number of idle slices postponed to a later frame gap
+  int deferredIdleSlices() const { return mDeferredIdleSlices; }
+
+  // Input priority mode: pokes are posted with Qt::LowEventPriority and a
+  // dispatch stops after a single DoWork() while a touch/key sequence is
+  // active or a compositing notification is pending, so Qt gets to deliver
+  // input and paint updates ahead of bulk Gecko work. Bulk work that waited
+  // longer than aStarvationLimit milliseconds runs a full batch again.
+  // The eventfd backend wakes up through posted pokes while this is on.
+  void setPrioritizeInput(bool aEnabled, int aStarvationLimit = 100);
+  bool prioritizeInput() const { return mPrioritizeInput.load(); }
+  // Thread safe, e.g. called from the compositor thread when a frame is ready
+  void notifyHighPriorityPending() { mHighPriorityPending.store(1); }
+  // Number of dispatches cut short to let pending input through
+  int inputYields() const { return mInputYields; }
+
+  virtual bool eventFilter(QObject* aObject, QEvent* aEvent);
+
+  // Call counters, duration histograms, delayed work lateness and queue
+  // depth collected since construction or the last resetStatistics()
+  QVariantMap statistics() const;
+  void resetStatistics();
+
+  // Report DoWork/DoDelayedWork/DoIdleWork phases to aWatchdog, NULL to stop
+  void setWatchdog(GeckoWatchdog* aWatchdog) { mWatchdog = aWatchdog; }
+
+  // Number of Run() invocations currently active
+  int runDepth() const { return mRunDepth; }
+
+  // Delayed work timer policy. Interactive pumps use precise timers that
+  // fire at the requested deadline. Background pumps use coarse timers
+  // and round deadlines up to a multiple of aSlack milliseconds, so that
+  // Gecko timers share wakeups.
+  void setBackground(bool aBackground, int aSlack = 50);
+  bool background() const { return mBackground; }
 
 public Q_SLOTS:
   void dispatchDelayed();
 
+Q_SIGNALS:
+  // Emitted after a dispatch that left no work and no idle work pending,
+  // the Gecko loop has nothing to do until the next ScheduleWork()
+  void idle();
+
+private Q_SLOTS:
+  void wakeupFdActivated();
+  void timerFdActivated();
+  void frameSwapped();
+
+protected:
+  virtual void timerEvent(QTimerEvent* aEvent);
+
 private:
+  bool setupFdBackend();
+  bool mayRunIdleWork();
+  bool doWork();
+  bool doDelayedWork();
+  bool doIdleWork();
+  bool shouldYieldToInput();
+  bool isStarving() const;
+  bool runIdleWork();
+
   // We may make recursive calls to Run, so we save state that needs to be
   // separate between them in this structure type.
   struct RunState {
@@ -51,13 +167,73 @@ private:
     // Used to count how many Run() invocations are on the stack.
     int run_depth;
   };
+  // Nested loops from modal prompts rarely go deeper than a few levels,
+  // the states live in a fixed array so Run()/Quit() never allocate.
+  enum { MaxRunDepth = 32 };
 
   mozilla::embedlite::EmbedLiteApp* mApp;
   mozilla::embedlite::EmbedLiteMessagePump* mEventLoopPrivate;
   QTimer* mTimer;
+  Backend mBackend;
+  int mWakeupFd;
+  int mTimerFd;
+  QSocketNotifier* mWakeupNotifier;
+  QSocketNotifier* mTimerNotifier;
+  RunState mRunStates[MaxRunDepth];
+  // Innermost active state, NULL when no Run() is active
   RunState* state_;
+  // Active Run() invocations, may exceed MaxRunDepth
+  int mRunDepth;
   int mLastDelayedWorkTime;
+  bool mBackground;
+  int mTimerSlack;
+  // mClock time the delayed work timer is currently armed for, -1 if none
+  qint64 mArmedExpiry;
+  // Gecko called ScheduleDelayedWork() during the current DoDelayedWork()
+  bool mDelayedWorkRescheduled;
   bool mStarted;
+  // Flags read by ScheduleWork() on other threads
+  QAtomicInt mCoalescePokes;
+  int mDispatchBudget;
+  QPointer<QQuickWindow> mIdleFrameWindow;
+  int mIdleBudgetPerFrame;
+  // Microseconds spent in DoIdleWork() since the last frame swap
+  qint64 mIdleSpentThisFrame;
+  // Valid while we are inside a post-frame gap
+  QElapsedTimer mFrameGap;
+  bool mIdleDeferred;
+  int mIdleFallbackTimerId;
+  int mDeferredIdleSlices;
+  QAtomicInt mPrioritizeInput;
+  QAtomicInt mStarvationLimit;
+  // Touch or key sequence currently in progress
+  QAtomicInt mInteractive;
+  QAtomicInt mHighPriorityPending;
+  // The pending poke was posted with Qt::LowEventPriority
+  QAtomicInt mLowPriorityPoke;
+  // mClock time the last dispatch started at, -1 before the first one
+  QAtomicInteger<qint64> mLastDispatchTime;
+  int mInputYields;
+
+  // Instrumentation
+  QElapsedTimer mClock;
+  // Absolute mClock time at which the pending delayed work is due, -1 if
+  // none. Drives the delayed work timer and the lateness statistics.
+  qint64 mDelayedWorkDeadline;
+  quint64 mDoWorkCalls;
+  quint64 mDoDelayedWorkCalls;
+  quint64 mDoIdleWorkCalls;
+  PumpHistogram mDoWorkTime;
+  PumpHistogram mDoDelayedWorkTime;
+  PumpHistogram mDoIdleWorkTime;
+  PumpHistogram mDelayedWorkLateness;
+  // Pokes posted or written and not yet handled
+  QAtomicInt mOutstandingPokes;
+  GeckoWatchdog* mWatchdog;
+  // Set while a poke event is queued and not yet handled,
+  // ScheduleWork() may be called from any thread
+  QAtomicInt mPokePending;
+  QAtomicInt mCoalescedPokes;
 };
 
 #endif /* qmessagepump_h */
@@ -12,12 +12,30 @@
 #include <QJsonDocument>
 #include <QJsonParseError>
 #include <QtQml/QtQml>
+#include <QPointer>
+#include <QSet>
+#include <QHash>
+#include <QMetaMethod>
+#include <QThreadStorage>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTimer>
+#include <QtQuick/QQuickWindow>
+#include <limits>
 
 #include "qmozembedlog.h"
 #include "qmozcontext.h"
 #include "geckoworker.h"
+#include "geckowatchdog.h"
 #include "qmessagepump.h"
 #include "qmozviewcreator.h"
+#include "qmozjsonpayload.h"
+#include "qmozmessageserializer.h"
+#include "qmozpayloaddecoder.h"
+#include "qmozpostqueue.h"
+#include "qmozview_defined_wrapper.h"
 
 #include "nsDebug.h"
 #include "mozilla/embedlite/EmbedLiteMessagePump.h"
@@ -28,6 +46,68 @@
 using namespace mozilla::embedlite;
 
 static QMozContext* protectSingleton = nullptr;
+static int sPumpType = -1;
+static bool sLoadAsynchronously = false;
+
+/*
+ * dlopen()s libxul and binds the EmbedLite entry points off the GUI
+ * thread, QMozContext::bindEmbedLite() takes over once it finishes.
+ */
+class EmbedLiteLoader : public QThread
+{
+protected:
+    virtual void run()
+    {
+        LoadEmbedLite();
+    }
+};
+
+static QMozContext::PumpType
+selectedPumpType()
+{
+    if (sPumpType >= 0) {
+        return static_cast<QMozContext::PumpType>(sPumpType);
+    }
+    return getenv("USE_ASYNC") ? QMozContext::QtEventPump : QMozContext::GeckoPump;
+}
+
+struct ObserverHandlerEntry {
+    int id;
+    // One of the two is set
+    QMozContext::ObserverHandler handler;
+    QMozContext::ObserverPayloadHandler payloadHandler;
+};
+
+class QMozContextPrivate;
+
+/*
+ * Listener of a pre-created view waiting in the spare pool until a
+ * QuickMozView adopts it.
+ */
+class QMozSpareView : public EmbedLiteViewListener
+{
+public:
+    QMozSpareView(QMozContextPrivate* aContext, EmbedLiteView* aView)
+        : view(aView)
+        , ready(false)
+        , initUsec(0)
+        , mContext(aContext)
+    {
+        created.start();
+    }
+
+    virtual void ViewInitialized();
+    virtual void ViewDestroyed();
+
+    EmbedLiteView* view;
+    bool ready;
+    QElapsedTimer created;
+    // CreateView() to ViewInitialized(), what adopting it saves
+    qint64 initUsec;
+
+private:
+    QMozContextPrivate* mContext;
+};
 
 class QMozContextPrivate : public EmbedLiteAppListener {
 public:
@@ -39,20 +119,118 @@ public:
     , mThread(new QThread())
     , mEmbedStarted(false)
     , mQtPump(NULL)
-    , mAsyncContext(getenv("USE_ASYNC"))
+    , mPumpType(selectedPumpType())
+    , mAsyncContext(mPumpType != QMozContext::GeckoPump)
     , mViewCreator(NULL)
+    , mDispatchBudget(0)
+    , mIdleBudgetPerFrame(0)
+    , mWatchdog(NULL)
+    , mBackgroundTimerSlack(50)
+    , mNextObserverHandlerId(1)
+    , mSyncMessageDeadline(200)
+    , mPayloadDecoder(new QMozPayloadDecoder())
+    , mPostOverflowPolicy(QMozContext::RejectWhenFull)
+    , mPostMessageFormat(QMozMessageSerializer::CompactJson)
+    , mPostDropped(0)
+    , mPostApplied(0)
+    , mPrefBatchDepth(0)
+    , mLoader(NULL)
+    , mPendingRunEmbedding(false)
+    , mPendingRunDelay(-1)
+    , mPrioritizeInput(false)
+    , mSpareViewPoolSize(0)
+    , mSpareRefillTimer(new QTimer())
+    , mSpareRefillOnIdle(false)
+    , mSpareHits(0)
+    , mSpareMisses(0)
+    , mSpareSavedUsec(0)
     {
+        // Refills wait a second and then for the Gecko loop to go idle,
+        // the tab that just took a spare loads first
+        mSpareRefillTimer->setSingleShot(true);
+        mSpareRefillTimer->setInterval(1000);
+        mSpareRefillTimer->setTimerType(Qt::CoarseTimer);
+        QObject::connect(mSpareRefillTimer, SIGNAL(timeout()), q, SLOT(sparePoolRefillDue()));
+
         LOGT("Create new Context: %p, parent:%p", (void*)this, (void*)qq);
+        mStartupClock.start();
+        recordStartupPhase(QStringLiteral("contextCreated"));
         setenv("BUILD_GRE_HOME", BUILD_GRE_HOME, 1);
+        if (sLoadAsynchronously) {
+            mLoader = new EmbedLiteLoader();
+            QObject::connect(mLoader, SIGNAL(finished()), q, SLOT(bindEmbedLite()));
+            mLoader->start();
+            return;
+        }
         LoadEmbedLite();
+        bindApp();
+    }
+
+    // Runs on the GUI thread once LoadEmbedLite() is done
+    void bindApp()
+    {
+        recordStartupPhase(QStringLiteral("embedLiteLoaded"));
         mApp = XRE_GetEmbedLite();
+        recordStartupPhase(QStringLiteral("embedLiteAppCreated"));
         mApp->SetListener(this);
         if (mAsyncContext) {
-            mQtPump = new MessagePumpQt(mApp);
+            mQtPump = new MessagePumpQt(mApp, mPumpType == QMozContext::QtNativePump ?
+                                              MessagePumpQt::EventFdBackend :
+                                              MessagePumpQt::PostEventBackend);
+            // Settings made while the library was loading
+            mQtPump->setDispatchBudget(mDispatchBudget);
+            mQtPump->setIdleBudgetPerFrame(mIdleBudgetPerFrame);
+            if (mIdleBudgetPerFrame && mIdleFrameWindow) {
+                mQtPump->setIdleFrameWindow(mIdleFrameWindow.data());
+            }
+            if (mPrioritizeInput) {
+                mQtPump->setPrioritizeInput(true);
+            }
+            if (mWatchdog) {
+                mQtPump->setWatchdog(mWatchdog);
+            }
+            QObject::connect(mQtPump, SIGNAL(idle()), q, SLOT(pumpIdle()));
+        }
+    }
+    void scheduleSpareRefill()
+    {
+        if (mSpareViews.size() < mSpareViewPoolSize && !mSpareRefillTimer->isActive()) {
+            mSpareRefillTimer->start();
+        }
+    }
+    void destroySpareViews(int aKeep)
+    {
+        while (mSpareViews.size() > aKeep) {
+            QMozSpareView* spare = mSpareViews.takeLast();
+            if (spare->view && mApp) {
+                spare->view->SetListener(NULL);
+                mApp->DestroyView(spare->view);
+            }
+            delete spare;
+        }
+    }
+    // Calls that need the EmbedLiteApp, deferred while the library loads
+    void whenAppBound(const std::function<void()>& aCall)
+    {
+        if (mApp) {
+            aCall();
+        } else {
+            mPendingAppCalls.append(aCall);
         }
     }
 
     virtual ~QMozContextPrivate() {
+        delete mSpareRefillTimer;
+        if (mLoader) {
+            // dlopen() cannot be interrupted
+            mLoader->wait();
+            delete mLoader;
+        }
+        if (mQtPump) {
+            mQtPump->setWatchdog(NULL);
+        }
+        delete mWatchdog;
+        delete mPayloadDecoder;
         // deleting a running thread may result in a crash
         if (!mThread->isFinished()) {
             mThread->exit(0);
@@ -71,6 +249,7 @@ public:
             worker->moveToThread(mThread);
 
             mThread->start(QThread::LowPriority);
+            recordStartupPhase(QStringLiteral("childThreadStarted"));
             return true;
         }
         return false;
@@ -88,20 +267,34 @@ public:
     // App Initialized and ready to API call
     virtual void Initialized() {
         mInitialized = true;
+        recordStartupPhase(QStringLiteral("initialized"));
 #if defined(GL_PROVIDER_EGL) || defined(GL_PROVIDER_GLX)
         if (mApp->GetRenderType() == EmbedLiteApp::RENDER_AUTO) {
             mApp->SetIsAccelerated(true);
         }
 #endif
         setDefaultPrefs();
+        // Prefs set before initialization, unless a batch is still open
+        if (mPrefBatchDepth == 0) {
+            applyPendingPrefs();
+        }
         mApp->LoadGlobalStyleSheet("chrome://global/content/embedScrollStyles.css", true);
-        Q_EMIT q->onInitialized();
-        QListIterator<QString> i(mObserversList);
-        while (i.hasNext()) {
-            const QString& str = i.next();
-            mApp->AddObserver(str.toUtf8().data());
+        // MessageBatch.js and other frame script helpers
+        mApp->AddManifestLocation(QTMOZEMBED_CHROME_MANIFEST);
+        // Topics subscribed before initialization and still referenced
+        if (!mObserverRefCounts.isEmpty()) {
+            nsTArray<nsCString> observersList;
+            for (QHash<QString, int>::const_iterator it = mObserverRefCounts.constBegin(); it != mObserverRefCounts.constEnd(); ++it) {
+                observersList.AppendElement(it.key().toUtf8().data());
+            }
+            mApp->AddObservers(observersList);
         }
-        mObserversList.clear();
+        // Topics added from here on are subscribed right away
+        Q_EMIT q->onInitialized();
+        // Items posted by other threads before initialization
+        mPostDraining.store(1);
+        q->drainPostQueue();
+        scheduleSpareRefill();
     }
     // App Destroyed, and ready to delete and program exit
     virtual void Destroyed() {
@@ -111,25 +304,59 @@ public:
         }
     }
     virtual void OnObserve(const char* aTopic, const char16_t* aData) {
+        GeckoWatchdogScope phase(mWatchdog, "OnObserve");
         // LOGT("aTopic: %s, data: %s", aTopic, NS_ConvertUTF16toUTF8(aData).get());
-        QString data((QChar*)aData);
-        if (!data.startsWith('{') && !data.startsWith('[') && !data.startsWith('"')) {
-            QVariant vdata = QVariant::fromValue(data);
-            Q_EMIT q->recvObserve(aTopic, vdata);
+        QString topic(aTopic);
+        // Copy, handlers may register or unregister while being called
+        QList<ObserverHandlerEntry> handlers = mObserverHandlers.value(topic);
+        bool broadcast = q->isSignalConnected(QMetaMethod::fromSignal(&QMozContext::recvObserve));
+        if (handlers.isEmpty() && !broadcast) {
             return;
         }
-        bool ok = true;
-        QJsonParseError error;
-        QJsonDocument doc = QJsonDocument::fromJson(data.toUtf8(), &error);
-        ok = error.error == QJsonParseError::NoError;
-        QVariant vdata = doc.toVariant();
-        if (ok) {
-            // LOGT("mesg:%s, data:%s", aTopic, data.toUtf8().data());
-            Q_EMIT q->recvObserve(aTopic, vdata);
-        } else {
-            LOGT("parse: s:'%s', err:%s, errLine:%i", data.toUtf8().data(), error.errorString().toUtf8().data(), error.offset);
+
+        // Parsed on demand, payload handlers may not need the data at all
+        QMozJsonPayload payload(QString((QChar*)aData));
+        bool variantHandlers = broadcast;
+        Q_FOREACH (const ObserverHandlerEntry& entry, handlers) {
+            if (entry.payloadHandler) {
+                entry.payloadHandler(topic, &payload);
+            } else {
+                variantHandlers = true;
+            }
+        }
+        if (variantHandlers) {
+            // Large payloads are parsed off the GUI thread, delivered in order per topic
+            mPayloadDecoder->decode(this, topic, payload, [this, topic](const QVariant& aData, bool aOk) {
+                deliverObserve(topic, aData, aOk);
+            });
         }
     }
+    void deliverObserve(const QString& aTopic, const QVariant& aData, bool aOk)
+    {
+        if (!aOk) {
+            return;
+        }
+        // Handlers as registered at delivery time
+        Q_FOREACH (const ObserverHandlerEntry& entry, mObserverHandlers.value(aTopic)) {
+            if (entry.handler) {
+                entry.handler(aTopic, aData);
+            }
+        }
+        if (q->isSignalConnected(QMetaMethod::fromSignal(&QMozContext::recvObserve))) {
+            // LOGT("mesg:%s", aTopic.toUtf8().data());
+            Q_EMIT q->recvObserve(aTopic, aData);
+        }
+    }
+    int addObserverHandler(const QString& aTopic, const ObserverHandlerEntry& aEntry)
+    {
+        QList<ObserverHandlerEntry>& handlers = mObserverHandlers[aTopic];
+        if (handlers.isEmpty()) {
+            q->addObserver(aTopic);
+        }
+        handlers.append(aEntry);
+        mObserverHandlerTopics.insert(aEntry.id, aTopic);
+        return aEntry.id;
+    }
     void setDefaultPrefs()
     {
         if (getenv("DS_UA")) {
@@ -150,6 +377,63 @@ public:
         }
     }
     bool IsInitialized() { return mApp && mInitialized; }
+    // First occurrence of aPhase only
+    void recordStartupPhase(const QString& aPhase)
+    {
+        // Views opened long after startup are of no interest here
+        if (mStartupTimeline.size() >= 64) {
+            return;
+        }
+        Q_FOREACH (const StartupPhase& phase, mStartupTimeline) {
+            if (phase.name == aPhase) {
+                return;
+            }
+        }
+        StartupPhase phase = { aPhase, mStartupClock.nsecsElapsed() / 1000 };
+        mStartupTimeline.append(phase);
+    }
+    void applyPref(const QString& aName, const QVariant& aPref)
+    {
+        const QByteArray name = aName.toUtf8();
+        switch (aPref.type()) {
+        case QVariant::String:
+            mApp->SetCharPref(name.constData(), aPref.toString().toUtf8().constData());
+            break;
+        case QVariant::Int:
+        case QVariant::UInt:
+        case QVariant::LongLong:
+        case QVariant::ULongLong:
+            mApp->SetIntPref(name.constData(), aPref.toInt());
+            break;
+        case QVariant::Bool:
+            mApp->SetBoolPref(name.constData(), aPref.toBool());
+            break;
+        case QMetaType::Float:
+        case QMetaType::Double: {
+            // Gecko has no float prefs, fractions are read back from
+            // char prefs by Preferences::GetFloat()
+            double value = aPref.toDouble();
+            if (value >= std::numeric_limits<int>::min() && value <= std::numeric_limits<int>::max() &&
+                value == int(value)) {
+                mApp->SetIntPref(name.constData(), int(value));
+            } else {
+                mApp->SetCharPref(name.constData(), QByteArray::number(value, 'g', 15).constData());
+            }
+            break;
+        }
+        default:
+            LOGT("Unknown pref type: %i", aPref.type());
+        }
+    }
+    // Pending prefs in one pass, in key order
+    void applyPendingPrefs()
+    {
+        LOGT("prefs:%i", mPendingPrefs.size());
+        for (QVariantMap::const_iterator it = mPendingPrefs.constBegin(); it != mPendingPrefs.constEnd(); ++it) {
+            applyPref(it.key(), it.value());
+        }
+        mPendingPrefs.clear();
+    }
 
     virtual uint32_t CreateNewWindowRequested(const uint32_t& chromeFlags, const char* uri, const uint32_t& contextFlags, EmbedLiteView* aParentView)
     {
@@ -160,7 +444,80 @@ public:
 
     EmbedLiteMessagePump* EmbedLoop() { return mQtPump->EmbedLoop(); }
 
-    QList<QString> mObserversList;
+    // Counts a thread inside a post*() call, ~QMozContext waits until
+    // none is left before freeing the queue and the lock
+    class PosterScope
+    {
+    public:
+        explicit PosterScope(QMozContextPrivate* aPrivate) : mPrivate(aPrivate) { mPrivate->mActivePosters.ref(); }
+        ~PosterScope() { mPrivate->mActivePosters.deref(); }
+
+    private:
+        QMozContextPrivate* mPrivate;
+    };
+
+    bool post(QMozPostItem* aItem)
+    {
+        bool pushed = !mPostShutdown.load() && mPostQueue.tryPush(aItem);
+        while (!pushed) {
+            // Nothing drains before Initialized() or after destruction
+            // started, do not wait for it
+            if (mPostOverflowPolicy.load() == QMozContext::RejectWhenFull ||
+                !mPostDraining.load() || mPostShutdown.load()) {
+                LOGT("post queue full, dropped:%s", aItem->name.toUtf8().data());
+                delete aItem;
+                mPostDropped.ref();
+                return false;
+            }
+            if (QThread::currentThread() == q->thread()) {
+                // Nobody else would make room
+                q->drainPostQueue();
+                pushed = mPostQueue.tryPush(aItem);
+                continue;
+            }
+            // Retried under the lock drainPostQueue() signals with, so
+            // room made in between is not missed
+            QMutexLocker locker(&mPostRoomMutex);
+            pushed = mPostQueue.tryPush(aItem);
+            if (!pushed && mPostDraining.load() && !mPostShutdown.load()) {
+                mPostRoom.wait(&mPostRoomMutex);
+            }
+        }
+        if (mPostQueue.scheduleDrain()) {
+            QMetaObject::invokeMethod(q, "drainPostQueue", Qt::QueuedConnection);
+        }
+        return true;
+    }
+    // Counts a reference to each topic, returns the ones Gecko has to
+    // start observing
+    QStringList refObservers(const QStringList& aTopics)
+    {
+        QStringList added;
+        Q_FOREACH (const QString& topic, aTopics) {
+            if (++mObserverRefCounts[topic] == 1) {
+                added.append(topic);
+            }
+        }
+        return added;
+    }
+    // Drops a reference to each topic, returns the ones nobody observes
+    // anymore. Unbalanced removals are ignored.
+    QStringList unrefObservers(const QStringList& aTopics)
+    {
+        QStringList removed;
+        Q_FOREACH (const QString& topic, aTopics) {
+            QHash<QString, int>::iterator count = mObserverRefCounts.find(topic);
+            if (count == mObserverRefCounts.end()) {
+                continue;
+            }
+            if (--count.value() == 0) {
+                mObserverRefCounts.erase(count);
+                removed.append(topic);
+            }
+        }
+        return removed;
+    }
+
 private:
     QMozContext* q;
     EmbedLiteApp* mApp;
@@ -171,10 +528,91 @@ private:
     bool mEmbedStarted;
     EmbedLiteMessagePump* mEventLoopPrivate;
     MessagePumpQt* mQtPump;
+    QMozContext::PumpType mPumpType;
     bool mAsyncContext;
     QMozViewCreator *mViewCreator;
+    int mDispatchBudget;
+    int mIdleBudgetPerFrame;
+    QPointer<QQuickWindow> mIdleFrameWindow;
+    GeckoWatchdog* mWatchdog;
+    QSet<QObject*> mInteractiveViews;
+    // Topic subscriptions by addObserver()/addObservers() and handlers,
+    // subscribed in Gecko once initialized
+    QHash<QString, int> mObserverRefCounts;
+    struct ViewEntry {
+        QObject* view;
+        EmbedLiteView* embedView;
+    };
+    QList<ViewEntry> mViews;
+    int mBackgroundTimerSlack;
+    QHash<QString, QList<ObserverHandlerEntry> > mObserverHandlers;
+    QHash<int, QString> mObserverHandlerTopics;
+    int mNextObserverHandlerId;
+    QMozMessageSerializer mSerializer;
+    QHash<QString, PumpHistogram> mSyncMessageLatency;
+    int mSyncMessageDeadline;
+    QVariant mSyncMessageDefaultReply;
+    QMozPayloadDecoder* mPayloadDecoder;
+    QMozPostQueue mPostQueue;
+    QAtomicInt mPostOverflowPolicy;
+    // messageFormat() as seen by posting threads
+    QAtomicInt mPostMessageFormat;
+    QAtomicInt mPostDropped;
+    int mPostApplied;
+    // Set once Initialized() drains the queue
+    QAtomicInt mPostDraining;
+    // Set when destruction starts, posts are dropped from then on
+    QAtomicInt mPostShutdown;
+    // Threads inside post*(), see PosterScope
+    QAtomicInt mActivePosters;
+    // Wakes posting threads waiting for room with WaitWhenFull
+    QMutex mPostRoomMutex;
+    QWaitCondition mPostRoom;
+    QVariantMap mPendingPrefs;
+    int mPrefBatchDepth;
+    struct StartupPhase {
+        QString name;
+        // Microseconds since the private was constructed
+        qint64 usec;
+    };
+    QElapsedTimer mStartupClock;
+    QList<StartupPhase> mStartupTimeline;
+    EmbedLiteLoader* mLoader;
+    QList<std::function<void()> > mPendingAppCalls;
+    // runEmbedding() called while the library loads, runs after appBound()
+    bool mPendingRunEmbedding;
+    int mPendingRunDelay;
+    bool mPrioritizeInput;
+    friend class QMozSpareView;
+    // Initialized ones first, then the one being created
+    QList<QMozSpareView*> mSpareViews;
+    int mSpareViewPoolSize;
+    QTimer* mSpareRefillTimer;
+    // Refill waits for the next idle() of the Qt pump
+    bool mSpareRefillOnIdle;
+    int mSpareHits;
+    int mSpareMisses;
+    qint64 mSpareSavedUsec;
 };
 
+void QMozSpareView::ViewInitialized()
+{
+    initUsec = created.nsecsElapsed() / 1000;
+    ready = true;
+    // Spares stay in the background until adopted
+    view->SetIsActive(false);
+    LOGT("spare view %u ready after %lli us", view->GetUniqueID(), initUsec);
+    mContext->scheduleSpareRefill();
+}
+
+void QMozSpareView::ViewDestroyed()
+{
+    // Gecko tore it down, refillSparePool() drops it
+    view = NULL;
+    ready = false;
+    mContext->mSpareRefillTimer->start();
+}
+
 QMozContext::QMozContext(QObject* parent)
     : QObject(parent)
     , d(new QMozContextPrivate(this))
@@ -185,17 +623,63 @@ QMozContext::QMozContext(QObject* parent)
 
 void QMozContext::setCompositorInSeparateThread(bool aEnabled)
 {
-    d->mApp->SetCompositorInSeparateThread(true);
+    d->whenAppBound([this]() {
+        d->mApp->SetCompositorInSeparateThread(true);
+    });
 }
 
 void QMozContext::setProfile(const QString profilePath)
 {
-    d->mApp->SetProfilePath(!profilePath.isEmpty() ? profilePath.toUtf8().data() : NULL);
+    d->whenAppBound([this, profilePath]() {
+        d->mApp->SetProfilePath(!profilePath.isEmpty() ? profilePath.toUtf8().data() : NULL);
+    });
+}
+
+void QMozContext::setLoadAsynchronously(bool aAsync)
+{
+    Q_ASSERT(protectSingleton == nullptr);
+    sLoadAsynchronously = aAsync;
+}
+
+bool QMozContext::isAppBound() const
+{
+    return d->mApp;
+}
+
+void QMozContext::bindEmbedLite()
+{
+    LOGT("EmbedLite loaded");
+    d->mLoader->deleteLater();
+    d->mLoader = NULL;
+    d->bindApp();
+    // In call order: manifests and profile among others
+    const QList<std::function<void()> > calls = d->mPendingAppCalls;
+    d->mPendingAppCalls.clear();
+    Q_FOREACH (const std::function<void()>& call, calls) {
+        call();
+    }
+    Q_EMIT appBound();
+    // Last, with GeckoPump it does not return until stopEmbedding()
+    if (d->mPendingRunEmbedding) {
+        d->mPendingRunEmbedding = false;
+        runEmbedding(d->mPendingRunDelay);
+    }
 }
 
 QMozContext::~QMozContext()
 {
     protectSingleton = nullptr;
+    {
+        // Posting threads still waiting for room give up
+        QMutexLocker locker(&d->mPostRoomMutex);
+        d->mPostShutdown.store(1);
+        d->mPostRoom.wakeAll();
+    }
+    // and leave post() before the queue and the lock go away
+    while (d->mActivePosters.load()) {
+        QThread::yieldCurrentThread();
+    }
+    d->destroySpareViews(0);
     if (d->mApp) {
         d->mApp->SetListener(NULL);
     }
@@ -208,10 +692,8 @@ QMozContext::sendObserve(const QString& aTopic, const QVariant& variant)
     if (!d->mApp)
         return;
 
-    QJsonDocument doc = QJsonDocument::fromVariant(variant);
-    QByteArray array = doc.toJson();
-
-    d->mApp->SendObserve(aTopic.toUtf8().data(), (const char16_t*)QString(array).constData());
+    const QString& data = serializeMessage(variant);
+    d->mApp->SendObserve(aTopic.toUtf8().data(), (const char16_t*)data.constData());
 }
 
 void
@@ -226,34 +708,190 @@ QMozContext::sendObserve(const QString& aTopic, const QString& string)
 void
 QMozContext::addComponentManifest(const QString& manifestPath)
 {
-    if (!d->mApp)
-        return;
-    d->mApp->AddManifestLocation(manifestPath.toUtf8().data());
+    d->whenAppBound([this, manifestPath]() {
+        d->mApp->AddManifestLocation(manifestPath.toUtf8().data());
+    });
 }
 
 void
 QMozContext::addObserver(const QString& aTopic)
 {
-    if (!d->IsInitialized()) {
-        d->mObserversList.append(aTopic);
+    // Before initialization the count is all there is, Initialized()
+    // subscribes the topics still referenced
+    if (d->refObservers(QStringList() << aTopic).isEmpty() || !d->IsInitialized()) {
         return;
     }
 
     d->mApp->AddObserver(aTopic.toUtf8().data());
 }
 
+void
+QMozContext::removeObserver(const QString& aTopic)
+{
+    if (d->unrefObservers(QStringList() << aTopic).isEmpty() || !d->IsInitialized()) {
+        return;
+    }
+
+    d->mApp->RemoveObserver(aTopic.toUtf8().data());
+}
+
+int QMozContext::observedTopicCount() const
+{
+    return d->mObserverRefCounts.size();
+}
+
+const QString& QMozContext::serializeMessage(const QVariant& aData)
+{
+    return d->mSerializer.serialize(aData);
+}
+
+const QByteArray& QMozContext::serializeMessageUtf8(const QVariant& aData, bool aIsJson)
+{
+    return d->mSerializer.serializeUtf8(aData, aIsJson);
+}
+
+const QByteArray& QMozContext::serializeReplyUtf8(const QMozReturnValue& aReply)
+{
+    switch (aReply.replyType()) {
+    case QMozReturnValue::StringReply:
+        return d->mSerializer.serializeStringUtf8(aReply.text());
+    case QMozReturnValue::NumberReply:
+        return d->mSerializer.serializeNumberUtf8(aReply.number());
+    case QMozReturnValue::BoolReply:
+        return d->mSerializer.serializeBoolUtf8(aReply.number() != 0);
+    case QMozReturnValue::JsonReply:
+        return d->mSerializer.serializeUtf8(aReply.text(), true);
+    default:
+        return d->mSerializer.serializeUtf8(aReply.getMessage());
+    }
+}
+
+const QString& QMozContext::serializeMessageBatch(const QVariantList& aMessages)
+{
+    return d->mSerializer.serializeBatch(aMessages);
+}
+
+void QMozContext::recordSyncMessageLatency(const QString& aMessage, qint64 aUsec)
+{
+    d->mSyncMessageLatency[aMessage].add(aUsec);
+}
+
+QVariantMap QMozContext::syncMessageStatistics() const
+{
+    QVariantMap statistics;
+    QHash<QString, PumpHistogram>::const_iterator it = d->mSyncMessageLatency.constBegin();
+    for (; it != d->mSyncMessageLatency.constEnd(); ++it) {
+        statistics.insert(it.key(), it.value().toVariantMap());
+    }
+    return statistics;
+}
+
+void QMozContext::resetSyncMessageStatistics()
+{
+    d->mSyncMessageLatency.clear();
+}
+
+QMozPayloadDecoder* QMozContext::payloadDecoder() const
+{
+    return d->mPayloadDecoder;
+}
+
+void QMozContext::setAsyncDecodeThreshold(int aChars)
+{
+    d->mPayloadDecoder->setThreshold(aChars);
+}
+
+void QMozContext::setSyncMessageDeadline(int aMsec)
+{
+    d->mSyncMessageDeadline = qMax(aMsec, 0);
+}
+
+int QMozContext::syncMessageDeadline() const
+{
+    return d->mSyncMessageDeadline;
+}
+
+void QMozContext::setSyncMessageDefaultReply(const QVariant& aReply)
+{
+    d->mSyncMessageDefaultReply = aReply;
+}
+
+QVariant QMozContext::syncMessageDefaultReply() const
+{
+    return d->mSyncMessageDefaultReply;
+}
+
+void QMozContext::setMessageFormat(MessageFormat aFormat)
+{
+    d->mSerializer.setFormat(aFormat == IndentedJson ? QMozMessageSerializer::IndentedJson :
+                                                       QMozMessageSerializer::CompactJson);
+    d->mPostMessageFormat.store(d->mSerializer.format());
+}
+
+QMozContext::MessageFormat QMozContext::messageFormat() const
+{
+    return d->mSerializer.format() == QMozMessageSerializer::IndentedJson ? IndentedJson : CompactJson;
+}
+
+int QMozContext::registerObserverHandler(const QString& aTopic, const ObserverHandler& aHandler)
+{
+    ObserverHandlerEntry entry = { d->mNextObserverHandlerId++, aHandler, ObserverPayloadHandler() };
+    return d->addObserverHandler(aTopic, entry);
+}
+
+int QMozContext::registerObserverPayloadHandler(const QString& aTopic, const ObserverPayloadHandler& aHandler)
+{
+    ObserverHandlerEntry entry = { d->mNextObserverHandlerId++, ObserverHandler(), aHandler };
+    return d->addObserverHandler(aTopic, entry);
+}
+
+void QMozContext::unregisterObserverHandler(int aId)
+{
+    QHash<int, QString>::iterator topic = d->mObserverHandlerTopics.find(aId);
+    if (topic == d->mObserverHandlerTopics.end()) {
+        return;
+    }
+    QList<ObserverHandlerEntry>& handlers = d->mObserverHandlers[*topic];
+    for (int i = 0; i < handlers.size(); ++i) {
+        if (handlers.at(i).id == aId) {
+            handlers.removeAt(i);
+            break;
+        }
+    }
+    // Handlers of a topic hold one subscription between them
+    if (handlers.isEmpty()) {
+        d->mObserverHandlers.remove(*topic);
+        removeObserver(*topic);
+    }
+    d->mObserverHandlerTopics.erase(topic);
+}
+
 void QMozContext::addObservers(const QStringList& aObserversList)
 {
-    if (!d->mApp)
+    const QStringList added = d->refObservers(aObserversList);
+    if (added.isEmpty() || !d->IsInitialized())
         return;
 
     nsTArray<nsCString> observersList;
-    for (int i = 0; i < aObserversList.size(); i++) {
-        observersList.AppendElement(aObserversList.at(i).toUtf8().data());
+    for (int i = 0; i < added.size(); i++) {
+        observersList.AppendElement(added.at(i).toUtf8().data());
     }
     d->mApp->AddObservers(observersList);
 }
 
+void QMozContext::removeObservers(const QStringList& aObserversList)
+{
+    const QStringList removed = d->unrefObservers(aObserversList);
+    if (removed.isEmpty() || !d->IsInitialized())
+        return;
+
+    nsTArray<nsCString> observersList;
+    for (int i = 0; i < removed.size(); i++) {
+        observersList.AppendElement(removed.at(i).toUtf8().data());
+    }
+    d->mApp->RemoveObservers(observersList);
+}
+
 QMozContext*
 QMozContext::GetInstance()
 {
@@ -265,8 +903,30 @@ QMozContext::GetInstance()
     return lsSingleton;
 }
 
+void QMozContext::setPumpType(PumpType aType)
+{
+    if (protectSingleton) {
+        LOGT("Error: pump type must be selected before the context is created");
+        return;
+    }
+    sPumpType = aType;
+}
+
+QMozContext::PumpType
+QMozContext::pumpType() const
+{
+    return d->mPumpType;
+}
+
 void QMozContext::runEmbedding(int aDelay)
 {
+    if (!d->mApp) {
+        // Started from bindEmbedLite(), returns right away meanwhile
+        d->mPendingRunEmbedding = true;
+        d->mPendingRunDelay = aDelay;
+        return;
+    }
+    d->recordStartupPhase(QStringLiteral("runEmbedding"));
     if (!d->mEmbedStarted) {
         d->mEmbedStarted = true;
         if (d->mAsyncContext) {
@@ -303,6 +963,14 @@ float QMozContext::pixelRatio() const
 
 void QMozContext::stopEmbedding()
 {
+    if (!d->mApp) {
+        // Not started yet, drop a pending runEmbedding() only
+        d->mPendingRunEmbedding = false;
+        return;
+    }
+    d->mSpareRefillTimer->stop();
+    d->mSpareRefillOnIdle = false;
+    d->destroySpareViews(0);
     GetApp()->Stop();
 }
 
@@ -315,10 +983,9 @@ QMozContext::createView(const QString& url, const quint32& parentId)
 void
 QMozContext::setIsAccelerated(bool aIsAccelerated)
 {
-    if (!d->mApp)
-        return;
-
-    d->mApp->SetIsAccelerated(aIsAccelerated);
+    d->whenAppBound([this, aIsAccelerated]() {
+        d->mApp->SetIsAccelerated(aIsAccelerated);
+    });
 }
 
 bool
@@ -333,46 +1000,522 @@ void
 QMozContext::setPref(const QString& aName, const QVariant& aPref)
 {
     LOGT("name:%s, type:%i", aName.toUtf8().data(), aPref.type());
-    if (!d->mInitialized) {
-        LOGT("Error: context not yet initialized");
+    if (!d->mInitialized || d->mPrefBatchDepth > 0) {
+        // Applied by Initialized() or commitPrefBatch(), last value wins
+        d->mPendingPrefs.insert(aName, aPref);
         return;
     }
-    switch (aPref.type()) {
-    case QVariant::String:
-        d->mApp->SetCharPref(aName.toUtf8().data(), aPref.toString().toUtf8().data());
-        break;
-    case QVariant::Int:
-    case QVariant::UInt:
-    case QVariant::LongLong:
-    case QVariant::ULongLong:
-        d->mApp->SetIntPref(aName.toUtf8().data(), aPref.toInt());
-        break;
-    case QVariant::Bool:
-        d->mApp->SetBoolPref(aName.toUtf8().data(), aPref.toBool());
-        break;
-    case QMetaType::Float:
-    case QMetaType::Double:
-        if (aPref.canConvert<int>()) {
-            d->mApp->SetIntPref(aName.toUtf8().data(), aPref.toInt());
-        } else {
-            d->mApp->SetCharPref(aName.toUtf8().data(), aPref.toString().toUtf8().data());
-        }
-        break;
-    default:
-        LOGT("Unknown pref type: %i", aPref.type());
+    d->applyPref(aName, aPref);
+}
+
+void
+QMozContext::setPrefs(const QVariantMap& aPrefs)
+{
+    beginPrefBatch();
+    for (QVariantMap::const_iterator it = aPrefs.constBegin(); it != aPrefs.constEnd(); ++it) {
+        d->mPendingPrefs.insert(it.key(), it.value());
+    }
+    commitPrefBatch();
+}
+
+void
+QMozContext::beginPrefBatch()
+{
+    d->mPrefBatchDepth++;
+}
+
+void
+QMozContext::commitPrefBatch()
+{
+    if (d->mPrefBatchDepth == 0) {
+        LOGT("Error: no pref batch to commit");
+        return;
+    }
+    if (--d->mPrefBatchDepth == 0 && d->mInitialized) {
+        d->applyPendingPrefs();
     }
 }
 
+void
+QMozContext::recordStartupPhase(const QString& aPhase)
+{
+    d->recordStartupPhase(aPhase);
+}
+
+QVariantList
+QMozContext::startupTimeline() const
+{
+    QVariantList timeline;
+    Q_FOREACH (const QMozContextPrivate::StartupPhase& phase, d->mStartupTimeline) {
+        QVariantMap entry;
+        entry.insert("phase", phase.name);
+        entry.insert("usec", phase.usec);
+        timeline.append(entry);
+    }
+    return timeline;
+}
+
+QString
+QMozContext::startupTimelineJson() const
+{
+    QVariantMap dump;
+    // Monotonic clock reading of the first phase, lines up with other
+    // QElapsedTimer based traces of the process
+    dump.insert("originMsec", d->mStartupClock.msecsSinceReference());
+    dump.insert("phases", startupTimeline());
+    return QString::fromUtf8(QJsonDocument::fromVariant(dump).toJson(QJsonDocument::Compact));
+}
+
+bool
+QMozContext::dumpStartupTimeline(const QString& aPath) const
+{
+    QFile file(aPath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        LOGT("Error: cannot write %s", aPath.toUtf8().data());
+        return false;
+    }
+    return file.write(startupTimelineJson().toUtf8()) >= 0;
+}
+
+int
+QMozContext::pendingPrefCount() const
+{
+    return d->mPendingPrefs.size();
+}
+
 void
 QMozContext::notifyFirstUIInitialized()
 {
     static bool sCalledOnce = false;
-    if (!sCalledOnce) {
+    if (!sCalledOnce && d->mApp) {
         d->mApp->SendObserve("final-ui-startup", NULL);
         sCalledOnce = true;
     }
 }
 
+void QMozContext::setDispatchBudget(int aMsec)
+{
+    d->mDispatchBudget = aMsec > 0 ? aMsec : 0;
+    if (d->mQtPump) {
+        d->mQtPump->setDispatchBudget(d->mDispatchBudget);
+    }
+}
+
+int QMozContext::dispatchBudget() const
+{
+    return d->mDispatchBudget;
+}
+
+void QMozContext::setIdleBudgetPerFrame(int aMsec)
+{
+    d->mIdleBudgetPerFrame = aMsec > 0 ? aMsec : 0;
+    if (d->mQtPump) {
+        d->mQtPump->setIdleBudgetPerFrame(d->mIdleBudgetPerFrame);
+        d->mQtPump->setIdleFrameWindow(d->mIdleBudgetPerFrame ? d->mIdleFrameWindow.data() : NULL);
+    }
+}
+
+int QMozContext::idleBudgetPerFrame() const
+{
+    return d->mIdleBudgetPerFrame;
+}
+
+int QMozContext::deferredIdleSlices() const
+{
+    return d->mQtPump ? d->mQtPump->deferredIdleSlices() : 0;
+}
+
+void QMozContext::setIdleFrameWindow(QQuickWindow* aWindow)
+{
+    d->mIdleFrameWindow = aWindow;
+    if (d->mQtPump && d->mIdleBudgetPerFrame) {
+        d->mQtPump->setIdleFrameWindow(aWindow);
+    }
+}
+
+void QMozContext::setPrioritizeInput(bool aEnabled)
+{
+    d->mPrioritizeInput = aEnabled;
+    if (d->mQtPump) {
+        d->mQtPump->setPrioritizeInput(aEnabled);
+    }
+}
+
+void QMozContext::setViewInteractive(QObject* aView, bool aInteractive)
+{
+    if (aInteractive) {
+        d->mInteractiveViews.insert(aView);
+    } else {
+        d->mInteractiveViews.remove(aView);
+    }
+    if (d->mQtPump) {
+        d->mQtPump->setBackground(d->mInteractiveViews.isEmpty(), d->mBackgroundTimerSlack);
+    }
+}
+
+void QMozContext::registerView(QObject* aView, EmbedLiteView* aEmbedView)
+{
+    for (int i = 0; i < d->mViews.size(); ++i) {
+        if (d->mViews.at(i).view == aView) {
+            d->mViews[i].embedView = aEmbedView;
+            return;
+        }
+    }
+    QMozContextPrivate::ViewEntry entry = { aView, aEmbedView };
+    d->mViews.append(entry);
+}
+
+void QMozContext::unregisterView(QObject* aView)
+{
+    for (int i = 0; i < d->mViews.size(); ++i) {
+        if (d->mViews.at(i).view == aView) {
+            d->mViews.removeAt(i);
+            return;
+        }
+    }
+}
+
+void QMozContext::forEachView(const ViewVisitor& aVisitor) const
+{
+    // A copy, visitors may close views
+    const QList<QMozContextPrivate::ViewEntry> views = d->mViews;
+    Q_FOREACH (const QMozContextPrivate::ViewEntry& entry, views) {
+        aVisitor(entry.view, entry.embedView);
+    }
+}
+
+QList<QObject*> QMozContext::views() const
+{
+    QList<QObject*> views;
+    Q_FOREACH (const QMozContextPrivate::ViewEntry& entry, d->mViews) {
+        views.append(entry.view);
+    }
+    return views;
+}
+
+int QMozContext::viewCount() const
+{
+    return d->mViews.size();
+}
+
+void QMozContext::broadcastAsyncMessage(const QString& name, const QVariant& variant)
+{
+    if (d->mViews.isEmpty()) {
+        return;
+    }
+
+    // SendAsyncMessage() only queues a copy, the shared buffer can be
+    // handed to every view
+    const QString& data = serializeMessage(variant);
+    LOGT("name:%s, views:%i", name.toUtf8().data(), d->mViews.size());
+    Q_FOREACH (const QMozContextPrivate::ViewEntry& entry, d->mViews) {
+        entry.embedView->SendAsyncMessage((const char16_t*)name.constData(), (const char16_t*)data.constData());
+    }
+}
+
+void QMozContext::setBackgroundTimerSlack(int aMsec)
+{
+    d->mBackgroundTimerSlack = aMsec;
+    if (d->mQtPump) {
+        d->mQtPump->setBackground(d->mQtPump->background(), aMsec);
+    }
+}
+
+void QMozContext::notifyCompositingFinished()
+{
+    if (d->mQtPump) {
+        d->mQtPump->notifyHighPriorityPending();
+    }
+}
+
+// Serializers of the posting threads, freed when the thread exits
+static QThreadStorage<QMozMessageSerializer*> sPostSerializers;
+
+static QString
+serializeForPost(const QVariant& aData, int aFormat)
+{
+    if (!sPostSerializers.hasLocalData()) {
+        sPostSerializers.setLocalData(new QMozMessageSerializer());
+    }
+    QMozMessageSerializer* serializer = sPostSerializers.localData();
+    serializer->setFormat(QMozMessageSerializer::Format(aFormat));
+    // Detached copy, the buffer stays with the thread
+    const QString& data = serializer->serialize(aData);
+    return QString(data.constData(), data.size());
+}
+
+bool QMozContext::postObserve(const QString& aTopic, const QVariant& aData)
+{
+    QMozContextPrivate::PosterScope poster(d);
+    QMozPostItem* item = new QMozPostItem(QMozPostItem::Observe, aTopic);
+    item->data = serializeForPost(aData, d->mPostMessageFormat.load());
+    return d->post(item);
+}
+
+bool QMozContext::postPref(const QString& aName, const QVariant& aValue)
+{
+    QMozContextPrivate::PosterScope poster(d);
+    QMozPostItem* item = new QMozPostItem(QMozPostItem::Pref, aName);
+    item->value = aValue;
+    return d->post(item);
+}
+
+bool QMozContext::postAsyncMessage(quint32 aViewId, const QString& aName, const QVariant& aData)
+{
+    QMozContextPrivate::PosterScope poster(d);
+    QMozPostItem* item = new QMozPostItem(QMozPostItem::AsyncMessage, aName);
+    item->viewId = aViewId;
+    item->data = serializeForPost(aData, d->mPostMessageFormat.load());
+    return d->post(item);
+}
+
+void QMozContext::drainPostQueue()
+{
+    if (!d->IsInitialized()) {
+        // Initialized() drains
+        return;
+    }
+    d->mPostQueue.drainStarted();
+    bool drained = false;
+    while (QMozPostItem* item = d->mPostQueue.pop()) {
+        drained = true;
+        bool applied = true;
+        switch (item->kind) {
+        case QMozPostItem::Observe:
+            d->mApp->SendObserve(item->name.toUtf8().data(), (const char16_t*)item->data.constData());
+            break;
+        case QMozPostItem::Pref:
+            setPref(item->name, item->value);
+            break;
+        case QMozPostItem::AsyncMessage:
+            applied = false;
+            Q_FOREACH (const QMozContextPrivate::ViewEntry& entry, d->mViews) {
+                if (entry.embedView->GetUniqueID() == item->viewId) {
+                    entry.embedView->SendAsyncMessage((const char16_t*)item->name.constData(),
+                                                      (const char16_t*)item->data.constData());
+                    applied = true;
+                    break;
+                }
+            }
+            if (!applied) {
+                LOGT("no view %u, dropped:%s", item->viewId, item->name.toUtf8().data());
+            }
+            break;
+        }
+        delete item;
+        if (applied) {
+            d->mPostApplied++;
+        } else {
+            d->mPostDropped.ref();
+        }
+    }
+    if (drained) {
+        QMutexLocker locker(&d->mPostRoomMutex);
+        d->mPostRoom.wakeAll();
+    }
+}
+
+int QMozContext::postQueueDepth() const
+{
+    return d->mPostQueue.depth();
+}
+
+QVariantMap QMozContext::postQueueStatistics() const
+{
+    QVariantMap statistics;
+    statistics.insert("depth", d->mPostQueue.depth());
+    statistics.insert("maxDepth", d->mPostQueue.maxDepth());
+    statistics.insert("capacity", d->mPostQueue.capacity());
+    statistics.insert("applied", d->mPostApplied);
+    statistics.insert("dropped", d->mPostDropped.load());
+    return statistics;
+}
+
+void QMozContext::resetPostQueueStatistics()
+{
+    d->mPostQueue.resetMaxDepth();
+    d->mPostApplied = 0;
+    d->mPostDropped.store(0);
+}
+
+void QMozContext::setPostQueueCapacity(int aItems)
+{
+    d->mPostQueue.setCapacity(aItems);
+}
+
+void QMozContext::setPostQueueOverflowPolicy(PostOverflowPolicy aPolicy)
+{
+    d->mPostOverflowPolicy.store(aPolicy);
+}
+
+void QMozContext::setSpareViewPoolSize(int aViews)
+{
+    d->mSpareViewPoolSize = qMax(aViews, 0);
+    d->destroySpareViews(d->mSpareViewPoolSize);
+    if (d->IsInitialized()) {
+        d->scheduleSpareRefill();
+    }
+}
+
+int QMozContext::spareViewPoolSize() const
+{
+    return d->mSpareViewPoolSize;
+}
+
+EmbedLiteView* QMozContext::takeSpareView()
+{
+    for (int i = 0; i < d->mSpareViews.size(); ++i) {
+        QMozSpareView* spare = d->mSpareViews.at(i);
+        if (spare->ready) {
+            EmbedLiteView* view = spare->view;
+            d->mSpareViews.removeAt(i);
+            d->mSpareHits++;
+            d->mSpareSavedUsec += spare->initUsec;
+            view->SetListener(NULL);
+            delete spare;
+            d->scheduleSpareRefill();
+            LOGT("adopted spare view %u", view->GetUniqueID());
+            return view;
+        }
+    }
+    // Tabs opened while the pool is off do not count against it
+    if (d->mSpareViewPoolSize > 0) {
+        d->mSpareMisses++;
+    }
+    if (d->IsInitialized()) {
+        d->scheduleSpareRefill();
+    }
+    return NULL;
+}
+
+void QMozContext::refillSparePool()
+{
+    if (!d->IsInitialized()) {
+        return;
+    }
+    QList<QMozSpareView*>::iterator it = d->mSpareViews.begin();
+    while (it != d->mSpareViews.end()) {
+        if (!(*it)->view) {
+            delete *it;
+            it = d->mSpareViews.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (d->mSpareViews.size() >= d->mSpareViewPoolSize) {
+        return;
+    }
+    // One at a time, the next is scheduled once this one is initialized
+    Q_FOREACH (QMozSpareView* spare, d->mSpareViews) {
+        if (!spare->ready) {
+            return;
+        }
+    }
+    EmbedLiteView* view = d->mApp->CreateView(0);
+    QMozSpareView* spare = new QMozSpareView(d, view);
+    view->SetListener(spare);
+    d->mSpareViews.append(spare);
+}
+
+void QMozContext::sparePoolRefillDue()
+{
+    // GeckoPump gives no idle hook, refill right away there
+    if (!d->mQtPump) {
+        refillSparePool();
+        return;
+    }
+    d->mSpareRefillOnIdle = true;
+    // A loop that is already quiet does not dispatch again by itself
+    d->mQtPump->ScheduleWork();
+}
+
+void QMozContext::pumpIdle()
+{
+    if (d->mSpareRefillOnIdle) {
+        d->mSpareRefillOnIdle = false;
+        refillSparePool();
+    }
+}
+
+QVariantMap QMozContext::spareViewStatistics() const
+{
+    int ready = 0;
+    Q_FOREACH (QMozSpareView* spare, d->mSpareViews) {
+        if (spare->ready) {
+            ready++;
+        }
+    }
+    int requests = d->mSpareHits + d->mSpareMisses;
+    QVariantMap statistics;
+    statistics.insert("poolSize", d->mSpareViewPoolSize);
+    statistics.insert("ready", ready);
+    statistics.insert("hits", d->mSpareHits);
+    statistics.insert("misses", d->mSpareMisses);
+    statistics.insert("hitRate", requests ? qreal(d->mSpareHits) / requests : 0.0);
+    // Sum and mean of the CreateView() to ViewInitialized() time of the
+    // spares handed out, what those tabs did not wait for
+    statistics.insert("savedMsec", d->mSpareSavedUsec / 1000.0);
+    statistics.insert("meanSavedMsec", d->mSpareHits ? d->mSpareSavedUsec / 1000.0 / d->mSpareHits : 0.0);
+    return statistics;
+}
+
+void QMozContext::resetSpareViewStatistics()
+{
+    d->mSpareHits = 0;
+    d->mSpareMisses = 0;
+    d->mSpareSavedUsec = 0;
+}
+
+QVariantMap QMozContext::pumpStatistics() const
+{
+    return d->mQtPump ? d->mQtPump->statistics() : QVariantMap();
+}
+
+void QMozContext::resetPumpStatistics()
+{
+    if (d->mQtPump) {
+        d->mQtPump->resetStatistics();
+    }
+}
+
+void QMozContext::setLongTaskThreshold(int aMsec)
+{
+    if (aMsec <= 0) {
+        if (d->mQtPump) {
+            d->mQtPump->setWatchdog(NULL);
+        }
+        if (d->mWatchdog) {
+            // May be called from a task the watchdog is timing, its scope
+            // still refers to it until the task returns
+            d->mWatchdog->deleteLater();
+            d->mWatchdog = NULL;
+        }
+        return;
+    }
+
+    if (d->mWatchdog) {
+        d->mWatchdog->setThreshold(aMsec);
+        return;
+    }
+
+    d->mWatchdog = new GeckoWatchdog(aMsec);
+    connect(d->mWatchdog, SIGNAL(longTaskDetected(QString,int)), this, SIGNAL(longTaskDetected(QString,int)));
+    if (d->mQtPump) {
+        d->mQtPump->setWatchdog(d->mWatchdog);
+    }
+    d->mWatchdog->start(QThread::LowPriority);
+}
+
+QVariantList QMozContext::recentLongTasks() const
+{
+    return d->mWatchdog ? d->mWatchdog->recentLongTasks() : QVariantList();
+}
+
+GeckoWatchdog* QMozContext::longTaskWatchdog() const
+{
+    return d->mWatchdog;
+}
+
 void QMozContext::setViewCreator(QMozViewCreator* viewCreator)
 {
     d->mViewCreator = viewCreator;
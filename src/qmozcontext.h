@@ -10,50 +10,264 @@
 #include <QObject>
 #include <QVariant>
 #include <QStringList>
+#include <functional>
 
 class QMozContextPrivate;
 
 namespace mozilla {
 namespace embedlite {
 class EmbedLiteApp;
+class EmbedLiteView;
 }}
 class QMozViewCreator;
+class QQuickWindow;
+class GeckoWatchdog;
+class QMozJsonPayload;
+class QMozPayloadDecoder;
+class QMozReturnValue;
 
 class QMozContext : public QObject
 {
     Q_OBJECT
+    Q_ENUMS(PumpType MessageFormat PostOverflowPolicy)
 public:
+    enum PumpType {
+        // Gecko runs its own event loop on the embedding thread
+        GeckoPump,
+        // Gecko loop is driven from the Qt thread by posted events and a QTimer
+        QtEventPump,
+        // Gecko loop is driven from the Qt thread by eventfd/timerfd socket notifiers
+        QtNativePump
+    };
+
+    enum MessageFormat {
+        // Indented QJsonDocument output, as older releases sent
+        IndentedJson,
+        // Whitespace free JSON written straight to UTF-16
+        CompactJson
+    };
+
+    enum PostOverflowPolicy {
+        // post*() returns false and drops the item
+        RejectWhenFull,
+        // post*() waits for the queue to drain, rejects like
+        // RejectWhenFull before initialization
+        WaitWhenFull
+    };
+
     virtual ~QMozContext();
 
+    typedef std::function<void(const QString& topic, const QVariant& data)> ObserverHandler;
+    typedef std::function<void(const QString& topic, QMozJsonPayload* payload)> ObserverPayloadHandler;
+    typedef std::function<void(QObject* view, mozilla::embedlite::EmbedLiteView* embedView)> ViewVisitor;
+
     mozilla::embedlite::EmbedLiteApp* GetApp();
     void setPixelRatio(float ratio);
     float pixelRatio() const;
     Q_INVOKABLE bool initialized() const;
     Q_INVOKABLE bool isAccelerated() const;
+    Q_INVOKABLE int dispatchBudget() const;
+    Q_INVOKABLE MessageFormat messageFormat() const;
+    Q_INVOKABLE int idleBudgetPerFrame() const;
+    Q_INVOKABLE int deferredIdleSlices() const;
+    // Counters and timing histograms of the Qt driven Gecko pump,
+    // empty when Gecko runs its own loop (GeckoPump)
+    Q_INVOKABLE QVariantMap pumpStatistics() const;
+    Q_INVOKABLE void resetPumpStatistics();
+    // Per message name count and latency histogram of sync messages
+    Q_INVOKABLE QVariantMap syncMessageStatistics() const;
+    Q_INVOKABLE void resetSyncMessageStatistics();
+    // Long tasks recorded by the watchdog, see setLongTaskThreshold()
+    Q_INVOKABLE QVariantList recentLongTasks() const;
+    // NULL unless a long task threshold is set
+    GeckoWatchdog* longTaskWatchdog() const;
+    // Window whose frame swaps gate Gecko idle work (GC/CC slices) on the
+    // Qt driven pump. Set by QuickMozView when it is added to a scene.
+    void setIdleFrameWindow(QQuickWindow* aWindow);
+    // Called by views from the compositor thread once a frame is ready,
+    // lets the prioritized pump yield to the pending paint update.
+    void notifyCompositingFinished();
+    // Views report whether they are active and in the foreground. While no
+    // view is interactive the Qt driven pump uses coarse, slack aligned
+    // timers for Gecko delayed work.
+    void setViewInteractive(QObject* aView, bool aInteractive);
+    // Registry of views with a live EmbedLiteView, kept up to date by the
+    // views from ViewInitialized() until the EmbedLiteView goes away
+    void registerView(QObject* aView, mozilla::embedlite::EmbedLiteView* aEmbedView);
+    void unregisterView(QObject* aView);
+    // Calls aVisitor for every registered view in registration order,
+    // views may unregister meanwhile
+    void forEachView(const ViewVisitor& aVisitor) const;
+    QList<QObject*> views() const;
+    Q_INVOKABLE int viewCount() const;
+    // Topics with at least one subscription
+    Q_INVOKABLE int observedTopicCount() const;
+    // Startup phases in the order reached, as {phase, usec} maps with
+    // microseconds since the context was created: contextCreated,
+    // embedLiteLoaded, embedLiteAppCreated, runEmbedding,
+    // childThreadStarted, initialized, createView, and
+    // viewInitialized:<id> and firstPaint:<id> per view
+    Q_INVOKABLE QVariantList startupTimeline() const;
+    // Same as a JSON object, with the monotonic clock origin
+    Q_INVOKABLE QString startupTimelineJson() const;
+    Q_INVOKABLE bool dumpStartupTimeline(const QString& aPath) const;
+    // Records the first time aPhase is reached, later calls are ignored
+    void recordStartupPhase(const QString& aPhase);
+    // Hands out an initialized, inactive view from the spare pool and
+    // schedules a refill, NULL when none is ready. The caller sets its
+    // own listener and calls its ViewInitialized() itself.
+    mozilla::embedlite::EmbedLiteView* takeSpareView();
+    Q_INVOKABLE int spareViewPoolSize() const;
+    // Pool size, ready spares, hits, misses, hit rate and the
+    // view initialization time saved by adopted spares
+    Q_INVOKABLE QVariantMap spareViewStatistics() const;
+    Q_INVOKABLE void resetSpareViewStatistics();
+    // Prefs waiting for initialization or commitPrefBatch()
+    Q_INVOKABLE int pendingPrefCount() const;
+    // Thread safe counterparts of sendObserve(), setPref() and
+    // sendAsyncMessage() for worker threads. Data is serialized on the
+    // calling thread and queued without locking; the context thread
+    // applies queued items in posting order per thread, holding them
+    // until Gecko is initialized. Return false when the item was dropped
+    // by the RejectWhenFull overflow policy or because the context is
+    // being destroyed, which waits for threads still inside these calls.
+    bool postObserve(const QString& aTopic, const QVariant& aData);
+    bool postPref(const QString& aName, const QVariant& aValue);
+    bool postAsyncMessage(quint32 aViewId, const QString& aName, const QVariant& aData);
+    // Items posted and not applied yet
+    Q_INVOKABLE int postQueueDepth() const;
+    // Depth, high watermark, applied and dropped counts of the post queue
+    Q_INVOKABLE QVariantMap postQueueStatistics() const;
+    Q_INVOKABLE void resetPostQueueStatistics();
+    // Serializes outbound observer and message data in messageFormat()
+    // into a buffer shared by the context and its views. The result is
+    // valid until the next call.
+    const QString& serializeMessage(const QVariant& aData);
+    // UTF-8 variant for sync message replies, see QMozReturnValue::setJson()
+    const QByteArray& serializeMessageUtf8(const QVariant& aData, bool aIsJson = false);
+    // Sync message reply in the same buffer, typed replies are written
+    // without going through a QVariant
+    const QByteArray& serializeReplyUtf8(const QMozReturnValue& aReply);
+    // Batch of {name, data} maps for QuickMozView::sendAsyncMessages()
+    const QString& serializeMessageBatch(const QVariantList& aMessages);
+    // Called by views after answering a sync message, content scripts
+    // stall for this long
+    void recordSyncMessageLatency(const QString& aMessage, qint64 aUsec);
+    // Decodes payloads for QVariant based signals, large ones off the GUI thread
+    QMozPayloadDecoder* payloadDecoder() const;
+    Q_INVOKABLE int syncMessageDeadline() const;
+    QVariant syncMessageDefaultReply() const;
+    // Calls aHandler for notifications of aTopic only, subscribing to the
+    // topic in Gecko. Notifications without a handler and without a
+    // recvObserve() connection are dropped before their data is parsed.
+    // Returns an id for unregisterObserverHandler().
+    int registerObserverHandler(const QString& aTopic, const ObserverHandler& aHandler);
+    // Same for handlers reading the unparsed payload, valid during the call
+    int registerObserverPayloadHandler(const QString& aTopic, const ObserverPayloadHandler& aHandler);
+    void unregisterObserverHandler(int aId);
 
     static QMozContext* GetInstance();
+    // Selects how the Gecko event loop is driven, must be called before
+    // the first GetInstance(). Defaults to QtEventPump when USE_ASYNC is
+    // set in the environment and GeckoPump otherwise.
+    static void setPumpType(PumpType aType);
+    // Loads libxul on a background thread instead of blocking the first
+    // GetInstance(), must be called before it. GetApp() is NULL until
+    // appBound(); calls needing the app are deferred until then. A
+    // runEmbedding() made meanwhile runs right after appBound().
+    static void setLoadAsynchronously(bool aAsync);
+    Q_INVOKABLE bool isAppBound() const;
+    PumpType pumpType() const;
 
 Q_SIGNALS:
     void onInitialized();
+    // The EmbedLite library is loaded and GetApp() is available
+    void appBound();
     void recvObserve(const QString message, const QVariant data);
+    // A DoWork/DoDelayedWork/DoIdleWork dispatch or a listener callback
+    // blocked the Gecko/Qt thread for longer than the long task threshold
+    void longTaskDetected(const QString& phase, int durationMs);
+    // A deferred sync message reply did not arrive within the deadline,
+    // Gecko got the default reply
+    void syncMessageTimedOut(const QString& message, int deadlineMs);
 
 public Q_SLOTS:
     void setIsAccelerated(bool aIsAccelerated);
     void addComponentManifest(const QString& manifestPath);
+    // Subscriptions are counted per topic, Gecko stops sending a topic
+    // once every addObserver() is matched by a removeObserver()
     void addObserver(const QString& aTopic);
+    void removeObserver(const QString& aTopic);
     void sendObserve(const QString& aTopic, const QString& string);
     void sendObserve(const QString& aTopic, const QVariant& variant);
+    // sendAsyncMessage() to every registered view, serialized once
+    void broadcastAsyncMessage(const QString& name, const QVariant& variant);
     // running this without delay specified will execute Gecko/Qt nested main loop
     // and block this call until stopEmbedding called
     void runEmbedding(int aDelay = -1);
     void stopEmbedding();
+    // Prefs set before initialization or inside a batch are queued, a
+    // repeated name keeps its last value. Initialized() and the outermost
+    // commitPrefBatch() apply the queue in one pass.
     void setPref(const QString& aName, const QVariant& aPref);
+    void setPrefs(const QVariantMap& aPrefs);
+    void beginPrefBatch();
+    void commitPrefBatch();
     void notifyFirstUIInitialized();
     void setProfile(const QString);
     void addObservers(const QStringList& aObserversList);
+    void removeObservers(const QStringList& aObserversList);
     void setCompositorInSeparateThread(bool aEnabled);
     void setViewCreator(QMozViewCreator* viewCreator);
     quint32 createView(const QString& url, const quint32& parentId = 0);
+    // Time in milliseconds the Qt driven Gecko loop (USE_ASYNC) may spend
+    // in one dispatch before yielding to Qt, 0 disables batching
+    void setDispatchBudget(int aMsec);
+    // Milliseconds of Gecko idle work allowed after each swapped frame,
+    // 0 (the default) runs idle work regardless of the frame schedule.
+    // Frames are counted on one window, the one of the view most recently
+    // added to a scene unless setIdleFrameWindow() picks another.
+    void setIdleBudgetPerFrame(int aMsec);
+    // Service input and compositing notifications ahead of bulk Gecko
+    // work on the Qt driven pump
+    void setPrioritizeInput(bool aEnabled);
+    // Start a watchdog reporting tasks longer than aMsec through
+    // longTaskDetected(), 0 stops it
+    void setLongTaskThreshold(int aMsec);
+    // Encoding of sendObserve() and sendAsyncMessage() data, CompactJson
+    // by default
+    void setMessageFormat(MessageFormat aFormat);
+    // Milliseconds Gecko, and the blocked GUI thread, wait for a sync
+    // message handler that called QMozReturnValue::defer() to answer
+    // from another thread. 0 answers with the default reply at once.
+    void setSyncMessageDeadline(int aMsec);
+    // Reply sent when a deferred answer misses the deadline, an invalid
+    // QVariant sends the empty reply unanswered messages always got
+    void setSyncMessageDefaultReply(const QVariant& aReply);
+    // Observer and async message data of at least aChars characters is
+    // parsed on a worker thread for recvObserve()/recvAsyncMessage(),
+    // results keep their order per view and topic. 0 parses everything
+    // on the GUI thread.
+    void setAsyncDecodeThreshold(int aChars);
+    // Granularity in milliseconds Gecko timer wakeups are aligned to while
+    // no view is interactive, 0 keeps background timers precise
+    void setBackgroundTimerSlack(int aMsec);
+    // Items the post queue holds before the overflow policy applies
+    void setPostQueueCapacity(int aItems);
+    void setPostQueueOverflowPolicy(PostOverflowPolicy aPolicy);
+    // Top level views kept created and initialized in the background
+    // for new parentless views to adopt, refilled when the Gecko loop
+    // goes idle. Views opened by a page, e.g. window.open() through
+    // QMozViewCreator, have a parent and never use the pool. 0, the
+    // default, disables the pool.
+    void setSpareViewPoolSize(int aViews);
+
+private Q_SLOTS:
+    void drainPostQueue();
+    void bindEmbedLite();
+    void refillSparePool();
+    void sparePoolRefillDue();
+    void pumpIdle();
 
 private:
     QMozContext(QObject* parent = 0);
@@ -0,0 +1,104 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QJsonParseError>
+
+#include "qmozembedlog.h"
+#include "qmozjsonpayload.h"
+
+QMozJsonPayload::QMozJsonPayload(const QString& raw, QObject *parent)
+    : QObject(parent)
+    , mRaw(raw)
+    , mParsed(false)
+    , mValid(false)
+{
+}
+
+QMozJsonPayload::~QMozJsonPayload()
+{
+}
+
+QString QMozJsonPayload::raw() const
+{
+    return mRaw;
+}
+
+int QMozJsonPayload::size() const
+{
+    return mRaw.size();
+}
+
+bool QMozJsonPayload::valid() const
+{
+    parse();
+    return mValid;
+}
+
+bool QMozJsonPayload::parsed() const
+{
+    return mParsed;
+}
+
+void QMozJsonPayload::parse() const
+{
+    if (mParsed) {
+        return;
+    }
+    mParsed = true;
+
+    if (!mRaw.startsWith('{') && !mRaw.startsWith('[') && !mRaw.startsWith('"')) {
+        mVariant = QVariant::fromValue(mRaw);
+        mValid = true;
+        return;
+    }
+
+    QJsonParseError error;
+    mDocument = QJsonDocument::fromJson(mRaw.toUtf8(), &error);
+    mValid = error.error == QJsonParseError::NoError;
+    if (!mValid) {
+        LOGT("parse: err:%s, errLine:%i", error.errorString().toUtf8().data(), error.offset);
+    }
+}
+
+bool QMozJsonPayload::contains(const QString& key) const
+{
+    parse();
+    return mDocument.isObject() && mDocument.object().contains(key);
+}
+
+QString QMozJsonPayload::string(const QString& key, const QString& defaultValue) const
+{
+    parse();
+    return mDocument.object().value(key).toString(defaultValue);
+}
+
+double QMozJsonPayload::number(const QString& key, double defaultValue) const
+{
+    parse();
+    return mDocument.object().value(key).toDouble(defaultValue);
+}
+
+bool QMozJsonPayload::boolean(const QString& key, bool defaultValue) const
+{
+    parse();
+    return mDocument.object().value(key).toBool(defaultValue);
+}
+
+QVariant QMozJsonPayload::value(const QString& key) const
+{
+    parse();
+    return mDocument.object().value(key).toVariant();
+}
+
+QVariant QMozJsonPayload::toVariant() const
+{
+    parse();
+    if (mValid && !mVariant.isValid()) {
+        mVariant = mDocument.toVariant();
+    }
+    return mVariant;
+}
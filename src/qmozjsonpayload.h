@@ -0,0 +1,59 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef QMOZJSONPAYLOAD_H
+#define QMOZJSONPAYLOAD_H
+
+#include <QObject>
+#include <QString>
+#include <QVariant>
+#include <QJsonDocument>
+
+/*!
+ * Observer or message data kept as received from Gecko. The text is
+ * parsed on the first getter call and each getter converts only the
+ * member it returns, so a handler that ignores the payload or reads a
+ * single field never builds the full QVariant tree.
+ *
+ * Text that does not start like JSON ('{', '[' or '"') is a plain string
+ * value. Payloads are emitted by reference and only valid while the
+ * signal handler runs, copy what is needed with toVariant().
+ */
+class QMozJsonPayload : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QString raw READ raw CONSTANT FINAL)
+    Q_PROPERTY(int size READ size CONSTANT FINAL)
+    Q_PROPERTY(bool valid READ valid CONSTANT FINAL)
+
+public:
+    explicit QMozJsonPayload(const QString& raw, QObject *parent = 0);
+    virtual ~QMozJsonPayload();
+
+    QString raw() const;
+    int size() const;
+    // Parses the payload, false if it is not well formed JSON
+    bool valid() const;
+    bool parsed() const;
+
+    Q_INVOKABLE bool contains(const QString& key) const;
+    Q_INVOKABLE QString string(const QString& key, const QString& defaultValue = QString()) const;
+    Q_INVOKABLE double number(const QString& key, double defaultValue = 0) const;
+    Q_INVOKABLE bool boolean(const QString& key, bool defaultValue = false) const;
+    Q_INVOKABLE QVariant value(const QString& key) const;
+    // Whole payload converted once and cached
+    Q_INVOKABLE QVariant toVariant() const;
+
+private:
+    void parse() const;
+
+    QString mRaw;
+    mutable bool mParsed;
+    mutable bool mValid;
+    mutable QJsonDocument mDocument;
+    mutable QVariant mVariant;
+};
+
+#endif
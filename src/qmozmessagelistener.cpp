@@ -0,0 +1,93 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <QMetaMethod>
+
+#include "qmozmessagelistener.h"
+#include "qmozjsonpayload.h"
+#include "qmozpayloaddecoder.h"
+#include "qmozcontext.h"
+#include "quickmozview.h"
+
+QMozMessageListener::QMozMessageListener(QObject *parent)
+    : QObject(parent)
+    , mHandlerId(0)
+{
+}
+
+QMozMessageListener::~QMozMessageListener()
+{
+    QMozContext::GetInstance()->payloadDecoder()->cancel(this);
+    unsubscribe();
+}
+
+QObject* QMozMessageListener::view() const
+{
+    return mView.data();
+}
+
+void QMozMessageListener::setView(QObject* view)
+{
+    QuickMozView* mozView = qobject_cast<QuickMozView*>(view);
+    if (mView == mozView) {
+        return;
+    }
+    if (view && !mozView) {
+        qWarning("MozMessageListener: view must be a QmlMozView");
+    }
+
+    unsubscribe();
+    mView = mozView;
+    subscribe();
+    Q_EMIT viewChanged();
+}
+
+QString QMozMessageListener::message() const
+{
+    return mMessage;
+}
+
+void QMozMessageListener::setMessage(const QString& message)
+{
+    if (mMessage == message) {
+        return;
+    }
+
+    unsubscribe();
+    mMessage = message;
+    subscribe();
+    Q_EMIT messageChanged();
+}
+
+void QMozMessageListener::subscribe()
+{
+    if (!mView || mMessage.isEmpty()) {
+        return;
+    }
+    mHandlerId = mView->registerMessageHandler(mMessage, [this](const QString& aMessage, QMozJsonPayload* aPayload) {
+        deliver(aMessage, aPayload);
+    });
+}
+
+void QMozMessageListener::unsubscribe()
+{
+    // A destroyed view took its handlers along
+    if (mHandlerId && mView) {
+        mView->unregisterMessageHandler(mHandlerId);
+    }
+    mHandlerId = 0;
+}
+
+void QMozMessageListener::deliver(const QString& message, QMozJsonPayload* payload)
+{
+    Q_EMIT payloadReceived(message, payload);
+    if (isSignalConnected(QMetaMethod::fromSignal(&QMozMessageListener::received))) {
+        QMozContext::GetInstance()->payloadDecoder()->decode(this, message, *payload, [this, message](const QVariant& aData, bool aOk) {
+            if (aOk) {
+                Q_EMIT received(message, aData);
+            }
+        });
+    }
+}
@@ -0,0 +1,63 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef QMOZMESSAGELISTENER_H
+#define QMOZMESSAGELISTENER_H
+
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QVariant>
+
+class QuickMozView;
+class QMozJsonPayload;
+
+/*!
+ * Declarative handler of a single async message name of a view:
+ *
+ *     MozMessageListener {
+ *         view: webView
+ *         message: "embed:scroll"
+ *         onReceived: console.log(data.top)
+ *     }
+ *
+ * Unlike QmlMozView::recvAsyncMessage(), only messages of that name are
+ * delivered, see QuickMozView::registerMessageHandler().
+ * payloadReceived() hands over the unparsed QMozJsonPayload, data is only
+ * parsed when received() has handlers or a payload getter is called.
+ */
+class QMozMessageListener : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QObject* view READ view WRITE setView NOTIFY viewChanged FINAL)
+    Q_PROPERTY(QString message READ message WRITE setMessage NOTIFY messageChanged FINAL)
+
+public:
+    QMozMessageListener(QObject *parent = 0);
+    virtual ~QMozMessageListener();
+
+    QObject* view() const;
+    void setView(QObject* view);
+
+    QString message() const;
+    void setMessage(const QString& message);
+
+Q_SIGNALS:
+    void viewChanged();
+    void messageChanged();
+    void received(const QString& message, const QVariant& data);
+    void payloadReceived(const QString& message, QMozJsonPayload* payload);
+
+private:
+    void subscribe();
+    void unsubscribe();
+    void deliver(const QString& message, QMozJsonPayload* payload);
+
+    QPointer<QuickMozView> mView;
+    QString mMessage;
+    int mHandlerId;
+};
+
+#endif
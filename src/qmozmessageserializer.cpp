@@ -0,0 +1,316 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <QJsonDocument>
+#include <QJsonValue>
+#include <QStringList>
+#include <qnumeric.h>
+#include <limits>
+
+#include "qmozmessageserializer.h"
+
+// Buffers grown beyond this many characters by a large message are
+// released instead of being kept for the next call
+static const int sMaxRetainedCapacity = 1024 * 1024;
+
+// QJsonDocument only holds objects and arrays, top level scalars are
+// written the compact way in both formats
+static bool isJsonContainer(const QVariant& aData)
+{
+    switch (int(aData.type())) {
+    case QVariant::Map:
+    case QVariant::Hash:
+    case QVariant::List:
+    case QVariant::StringList:
+        return true;
+    default:
+        return false;
+    }
+}
+
+QMozMessageSerializer::QMozMessageSerializer(Format aFormat, int aInitialCapacity)
+    : mFormat(aFormat)
+    , mInitialCapacity(aInitialCapacity)
+{
+    mBuffer.reserve(mInitialCapacity);
+    mUtf8Buffer.reserve(mInitialCapacity);
+}
+
+void QMozMessageSerializer::reset()
+{
+    if (mBuffer.capacity() > sMaxRetainedCapacity) {
+        mBuffer = QString();
+        mBuffer.reserve(mInitialCapacity);
+    }
+    // Keeps the reserved capacity
+    mBuffer.resize(0);
+}
+
+const QString& QMozMessageSerializer::serialize(const QVariant& aData)
+{
+    reset();
+    if (mFormat == IndentedJson && isJsonContainer(aData)) {
+        mBuffer.append(QString::fromUtf8(QJsonDocument::fromVariant(aData).toJson()));
+    } else {
+        write(aData);
+    }
+    return mBuffer;
+}
+
+const QString& QMozMessageSerializer::serializeBatch(const QVariantList& aMessages)
+{
+    if (mFormat == IndentedJson) {
+        QVariantList batch;
+        Q_FOREACH (const QVariant& message, aMessages) {
+            const QVariantMap entry = message.toMap();
+            const QString name = entry.value(QStringLiteral("name")).toString();
+            if (!name.isEmpty()) {
+                batch.append(QVariant(QVariantList() << name << entry.value(QStringLiteral("data"))));
+            }
+        }
+        return serialize(batch);
+    }
+
+    // Written in place, without building the intermediate list
+    reset();
+    mBuffer.append(QLatin1Char('['));
+    bool first = true;
+    Q_FOREACH (const QVariant& message, aMessages) {
+        const QVariantMap entry = message.toMap();
+        const QString name = entry.value(QStringLiteral("name")).toString();
+        if (name.isEmpty()) {
+            continue;
+        }
+        if (!first) {
+            mBuffer.append(QLatin1Char(','));
+        }
+        first = false;
+        mBuffer.append(QLatin1Char('['));
+        writeString(name);
+        mBuffer.append(QLatin1Char(','));
+        write(entry.value(QStringLiteral("data")));
+        mBuffer.append(QLatin1Char(']'));
+    }
+    mBuffer.append(QLatin1Char(']'));
+    return mBuffer;
+}
+
+void QMozMessageSerializer::resetUtf8()
+{
+    if (mUtf8Buffer.capacity() > sMaxRetainedCapacity) {
+        mUtf8Buffer = QByteArray();
+        mUtf8Buffer.reserve(mInitialCapacity);
+    }
+    mUtf8Buffer.resize(0);
+}
+
+const QByteArray& QMozMessageSerializer::serializeUtf8(const QVariant& aData, bool aIsJson)
+{
+    resetUtf8();
+    if (aIsJson) {
+        encodeUtf8(aData.toString());
+    } else if (mFormat == IndentedJson && isJsonContainer(aData)) {
+        mUtf8Buffer.append(QJsonDocument::fromVariant(aData).toJson());
+    } else {
+        encodeUtf8(serialize(aData));
+    }
+    return mUtf8Buffer;
+}
+
+const QByteArray& QMozMessageSerializer::serializeStringUtf8(const QString& aValue)
+{
+    reset();
+    writeString(aValue);
+    resetUtf8();
+    encodeUtf8(mBuffer);
+    return mUtf8Buffer;
+}
+
+const QByteArray& QMozMessageSerializer::serializeNumberUtf8(double aValue)
+{
+    reset();
+    writeDouble(aValue);
+    resetUtf8();
+    encodeUtf8(mBuffer);
+    return mUtf8Buffer;
+}
+
+const QByteArray& QMozMessageSerializer::serializeBoolUtf8(bool aValue)
+{
+    resetUtf8();
+    mUtf8Buffer.append(aValue ? "true" : "false");
+    return mUtf8Buffer;
+}
+
+void QMozMessageSerializer::encodeUtf8(const QString& aString)
+{
+    // QString::toUtf8() would allocate a new array for every reply
+    const ushort* chars = aString.utf16();
+    const int length = aString.size();
+    for (int i = 0; i < length; ++i) {
+        uint c = chars[i];
+        if (c < 0x80) {
+            mUtf8Buffer.append(char(c));
+            continue;
+        }
+        if (QChar::isHighSurrogate(c) && i + 1 < length && QChar::isLowSurrogate(chars[i + 1])) {
+            c = QChar::surrogateToUcs4(c, chars[++i]);
+        } else if (QChar::isSurrogate(c)) {
+            c = QChar::ReplacementCharacter;
+        }
+        if (c < 0x800) {
+            mUtf8Buffer.append(char(0xc0 | (c >> 6)));
+        } else {
+            if (c < 0x10000) {
+                mUtf8Buffer.append(char(0xe0 | (c >> 12)));
+            } else {
+                mUtf8Buffer.append(char(0xf0 | (c >> 18)));
+                mUtf8Buffer.append(char(0x80 | ((c >> 12) & 0x3f)));
+            }
+            mUtf8Buffer.append(char(0x80 | ((c >> 6) & 0x3f)));
+        }
+        mUtf8Buffer.append(char(0x80 | (c & 0x3f)));
+    }
+}
+
+void QMozMessageSerializer::write(const QVariant& aData)
+{
+    switch (int(aData.type())) {
+    case QVariant::Invalid:
+        mBuffer.append(QLatin1String("null"));
+        break;
+    case QVariant::Bool:
+        mBuffer.append(aData.toBool() ? QLatin1String("true") : QLatin1String("false"));
+        break;
+    case QVariant::Int:
+    case QVariant::LongLong:
+        mBuffer.append(QString::number(aData.toLongLong()));
+        break;
+    case QVariant::UInt:
+    case QVariant::ULongLong:
+        mBuffer.append(QString::number(aData.toULongLong()));
+        break;
+    case QMetaType::Float:
+    case QVariant::Double:
+        writeDouble(aData.toDouble());
+        break;
+    case QVariant::String:
+        writeString(aData.toString());
+        break;
+    case QVariant::StringList: {
+        const QStringList list = aData.toStringList();
+        mBuffer.append(QLatin1Char('['));
+        for (int i = 0; i < list.size(); ++i) {
+            if (i) {
+                mBuffer.append(QLatin1Char(','));
+            }
+            writeString(list.at(i));
+        }
+        mBuffer.append(QLatin1Char(']'));
+        break;
+    }
+    case QVariant::List: {
+        const QVariantList list = aData.toList();
+        mBuffer.append(QLatin1Char('['));
+        for (int i = 0; i < list.size(); ++i) {
+            if (i) {
+                mBuffer.append(QLatin1Char(','));
+            }
+            write(list.at(i));
+        }
+        mBuffer.append(QLatin1Char(']'));
+        break;
+    }
+    case QVariant::Map: {
+        const QVariantMap map = aData.toMap();
+        mBuffer.append(QLatin1Char('{'));
+        for (QVariantMap::const_iterator it = map.constBegin(); it != map.constEnd(); ++it) {
+            if (it != map.constBegin()) {
+                mBuffer.append(QLatin1Char(','));
+            }
+            writeString(it.key());
+            mBuffer.append(QLatin1Char(':'));
+            write(it.value());
+        }
+        mBuffer.append(QLatin1Char('}'));
+        break;
+    }
+    case QVariant::Hash: {
+        const QVariantHash hash = aData.toHash();
+        mBuffer.append(QLatin1Char('{'));
+        for (QVariantHash::const_iterator it = hash.constBegin(); it != hash.constEnd(); ++it) {
+            if (it != hash.constBegin()) {
+                mBuffer.append(QLatin1Char(','));
+            }
+            writeString(it.key());
+            mBuffer.append(QLatin1Char(':'));
+            write(it.value());
+        }
+        mBuffer.append(QLatin1Char('}'));
+        break;
+    }
+    default: {
+        // Anything else converts the way QJsonDocument::fromVariant() does
+        QJsonValue value = QJsonValue::fromVariant(aData);
+        if (value.isObject() || value.isArray()) {
+            write(value.toVariant());
+        } else if (value.isString()) {
+            writeString(value.toString());
+        } else if (value.isDouble()) {
+            writeDouble(value.toDouble());
+        } else if (value.isBool()) {
+            mBuffer.append(value.toBool() ? QLatin1String("true") : QLatin1String("false"));
+        } else {
+            mBuffer.append(QLatin1String("null"));
+        }
+        break;
+    }
+    }
+}
+
+void QMozMessageSerializer::writeString(const QString& aString)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    mBuffer.append(QLatin1Char('"'));
+    const QChar* chars = aString.constData();
+    const int length = aString.size();
+    int plain = 0;
+    for (int i = 0; i < length; ++i) {
+        ushort c = chars[i].unicode();
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        // Flush the run of characters that need no escaping
+        mBuffer.append(chars + plain, i - plain);
+        plain = i + 1;
+        switch (c) {
+        case '"': mBuffer.append(QLatin1String("\\\"")); break;
+        case '\\': mBuffer.append(QLatin1String("\\\\")); break;
+        case '\b': mBuffer.append(QLatin1String("\\b")); break;
+        case '\f': mBuffer.append(QLatin1String("\\f")); break;
+        case '\n': mBuffer.append(QLatin1String("\\n")); break;
+        case '\r': mBuffer.append(QLatin1String("\\r")); break;
+        case '\t': mBuffer.append(QLatin1String("\\t")); break;
+        default:
+            mBuffer.append(QLatin1String("\\u00"));
+            mBuffer.append(QLatin1Char(hex[c >> 4]));
+            mBuffer.append(QLatin1Char(hex[c & 0xf]));
+            break;
+        }
+    }
+    mBuffer.append(chars + plain, length - plain);
+    mBuffer.append(QLatin1Char('"'));
+}
+
+void QMozMessageSerializer::writeDouble(double aValue)
+{
+    // JSON has no representation for NaN and infinities
+    if (qIsNaN(aValue) || qIsInf(aValue)) {
+        mBuffer.append(QLatin1String("null"));
+        return;
+    }
+    mBuffer.append(QString::number(aValue, 'g', std::numeric_limits<double>::digits10 + 2));
+}
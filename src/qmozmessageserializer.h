@@ -0,0 +1,63 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef QMOZMESSAGESERIALIZER_H
+#define QMOZMESSAGESERIALIZER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVariant>
+
+/*!
+ * Turns outbound observer and message data into the UTF-16 JSON text
+ * EmbedLite expects. The compact format is written directly into a
+ * buffer that is reused across calls, skipping the QJsonDocument tree,
+ * the whitespace and the UTF-8 round trip of toJson().
+ */
+class QMozMessageSerializer
+{
+public:
+    enum Format {
+        // QJsonDocument::toJson() default output
+        IndentedJson,
+        // No whitespace, serialized straight to UTF-16
+        CompactJson
+    };
+
+    explicit QMozMessageSerializer(Format aFormat = CompactJson, int aInitialCapacity = 4096);
+
+    Format format() const { return mFormat; }
+    void setFormat(Format aFormat) { mFormat = aFormat; }
+
+    // The result stays valid until the next call
+    const QString& serialize(const QVariant& aData);
+    // Same as UTF-8, for replies handed back to Gecko as C strings. A
+    // string aData that is already JSON (aIsJson) is only re-encoded.
+    const QByteArray& serializeUtf8(const QVariant& aData, bool aIsJson = false);
+    // Scalar replies, written without going through a QVariant
+    const QByteArray& serializeStringUtf8(const QString& aValue);
+    const QByteArray& serializeNumberUtf8(double aValue);
+    const QByteArray& serializeBoolUtf8(bool aValue);
+    // Packs {name, data} maps into one [[name, data], ...] array, as
+    // unpacked by MessageBatch.js. Entries without a name are skipped.
+    const QString& serializeBatch(const QVariantList& aMessages);
+
+    int capacity() const { return mBuffer.capacity(); }
+
+private:
+    void reset();
+    void resetUtf8();
+    void write(const QVariant& aData);
+    void writeString(const QString& aString);
+    void writeDouble(double aValue);
+    void encodeUtf8(const QString& aString);
+
+    Format mFormat;
+    int mInitialCapacity;
+    QString mBuffer;
+    QByteArray mUtf8Buffer;
+};
+
+#endif
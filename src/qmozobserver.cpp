@@ -0,0 +1,63 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <QMetaMethod>
+
+#include "qmozobserver.h"
+#include "qmozcontext.h"
+#include "qmozjsonpayload.h"
+#include "qmozpayloaddecoder.h"
+
+QMozObserver::QMozObserver(QObject *parent)
+    : QObject(parent)
+    , mHandlerId(0)
+{
+}
+
+QMozObserver::~QMozObserver()
+{
+    QMozContext* context = QMozContext::GetInstance();
+    context->payloadDecoder()->cancel(this);
+    if (mHandlerId) {
+        context->unregisterObserverHandler(mHandlerId);
+    }
+}
+
+QString QMozObserver::topic() const
+{
+    return mTopic;
+}
+
+void QMozObserver::setTopic(const QString& topic)
+{
+    if (mTopic == topic) {
+        return;
+    }
+
+    QMozContext* context = QMozContext::GetInstance();
+    if (mHandlerId) {
+        context->unregisterObserverHandler(mHandlerId);
+        mHandlerId = 0;
+    }
+    mTopic = topic;
+    if (!mTopic.isEmpty()) {
+        mHandlerId = context->registerObserverPayloadHandler(mTopic, [this](const QString& aTopic, QMozJsonPayload* aPayload) {
+            deliver(aTopic, aPayload);
+        });
+    }
+    Q_EMIT topicChanged();
+}
+
+void QMozObserver::deliver(const QString& topic, QMozJsonPayload* payload)
+{
+    Q_EMIT payloadReceived(topic, payload);
+    if (isSignalConnected(QMetaMethod::fromSignal(&QMozObserver::received))) {
+        QMozContext::GetInstance()->payloadDecoder()->decode(this, topic, *payload, [this, topic](const QVariant& aData, bool aOk) {
+            if (aOk) {
+                Q_EMIT received(topic, aData);
+            }
+        });
+    }
+}
@@ -0,0 +1,52 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef QMOZOBSERVER_H
+#define QMOZOBSERVER_H
+
+#include <QObject>
+#include <QString>
+#include <QVariant>
+
+class QMozJsonPayload;
+
+/*!
+ * Declarative subscription to a single observer topic:
+ *
+ *     MozObserver {
+ *         topic: "embed:download"
+ *         onReceived: console.log(data.msg)
+ *     }
+ *
+ * Only notifications of topic are delivered, see
+ * QMozContext::registerObserverHandler(). Handlers of payloadReceived()
+ * get the unparsed QMozJsonPayload instead, data is only parsed when
+ * received() has handlers or a payload getter is called.
+ */
+class QMozObserver : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QString topic READ topic WRITE setTopic NOTIFY topicChanged FINAL)
+
+public:
+    QMozObserver(QObject *parent = 0);
+    virtual ~QMozObserver();
+
+    QString topic() const;
+    void setTopic(const QString& topic);
+
+Q_SIGNALS:
+    void topicChanged();
+    void received(const QString& topic, const QVariant& data);
+    void payloadReceived(const QString& topic, QMozJsonPayload* payload);
+
+private:
+    void deliver(const QString& topic, QMozJsonPayload* payload);
+
+    QString mTopic;
+    int mHandlerId;
+};
+
+#endif
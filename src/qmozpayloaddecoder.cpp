@@ -0,0 +1,161 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <QAtomicInt>
+#include <QRunnable>
+
+#include "qmozjsonpayload.h"
+#include "qmozpayloaddecoder.h"
+
+struct QMozPayloadDecoderEntry
+{
+    QString raw;
+    QVariant data;
+    bool ok;
+    // Set by the worker once data and ok are written
+    QAtomicInt done;
+    QMozPayloadDecoder::Callback deliver;
+};
+
+namespace {
+
+class DecodeTask : public QRunnable
+{
+public:
+    DecodeTask(const QSharedPointer<QMozPayloadDecoderEntry>& aEntry, QObject* aDecoder)
+        : mEntry(aEntry)
+        , mDecoder(aDecoder)
+    {
+    }
+
+    virtual void run()
+    {
+        // Same rules as on the GUI thread
+        QMozJsonPayload payload(mEntry->raw);
+        mEntry->ok = payload.valid();
+        mEntry->data = payload.toVariant();
+        mEntry->raw = QString();
+        mEntry->done.storeRelease(1);
+        QMetaObject::invokeMethod(mDecoder, "deliverFinished", Qt::QueuedConnection);
+    }
+
+private:
+    QSharedPointer<QMozPayloadDecoderEntry> mEntry;
+    QObject* mDecoder;
+};
+
+}
+
+QMozPayloadDecoder::QMozPayloadDecoder(QObject *parent)
+    : QObject(parent)
+    , mThreshold(256 * 1024)
+    , mPending(0)
+    , mOffThreadDecodes(0)
+{
+    // Enough to keep up with a burst, without competing with Gecko
+    mPool.setMaxThreadCount(2);
+}
+
+QMozPayloadDecoder::~QMozPayloadDecoder()
+{
+    // Tasks post to this object, let them finish first
+    mPool.waitForDone();
+}
+
+void QMozPayloadDecoder::setThreshold(int threshold)
+{
+    mThreshold = qMax(threshold, 0);
+}
+
+int QMozPayloadDecoder::threshold() const
+{
+    return mThreshold;
+}
+
+int QMozPayloadDecoder::pending() const
+{
+    return mPending;
+}
+
+int QMozPayloadDecoder::offThreadDecodes() const
+{
+    return mOffThreadDecodes;
+}
+
+void QMozPayloadDecoder::decode(const void* owner, const QString& channel, QMozJsonPayload& payload, const Callback& deliver)
+{
+    ChannelKey key(owner, channel);
+    QHash<ChannelKey, ChannelQueue>::iterator queue = mChannels.find(key);
+    bool offThread = mThreshold > 0 && payload.size() >= mThreshold && !payload.parsed();
+
+    if (!offThread && queue == mChannels.end()) {
+        // Fast path, nothing ahead of this one
+        deliver(payload.toVariant(), payload.valid());
+        return;
+    }
+
+    QSharedPointer<QMozPayloadDecoderEntry> entry(new QMozPayloadDecoderEntry);
+    entry->deliver = deliver;
+    entry->ok = false;
+    if (offThread) {
+        entry->raw = payload.raw();
+        mOffThreadDecodes++;
+        mPool.start(new DecodeTask(entry, this));
+    } else {
+        entry->ok = payload.valid();
+        entry->data = payload.toVariant();
+        entry->done.storeRelease(1);
+    }
+    mChannels[key].append(entry);
+    mPending++;
+}
+
+void QMozPayloadDecoder::cancel(const void* owner)
+{
+    QHash<ChannelKey, ChannelQueue>::iterator it = mChannels.begin();
+    while (it != mChannels.end()) {
+        if (it.key().first == owner) {
+            // Running tasks still hold their entry, results are dropped
+            mPending -= it.value().size();
+            it = mChannels.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void QMozPayloadDecoder::deliverFinished()
+{
+    // Delivery may decode more or cancel, work on a snapshot of the keys
+    QList<ChannelKey> keys = mChannels.keys();
+    Q_FOREACH (const ChannelKey& key, keys) {
+        drain(key);
+    }
+}
+
+void QMozPayloadDecoder::drain(const ChannelKey& key)
+{
+    Q_FOREVER {
+        QHash<ChannelKey, ChannelQueue>::iterator queue = mChannels.find(key);
+        if (queue == mChannels.end()) {
+            return;
+        }
+        if (queue->isEmpty()) {
+            mChannels.erase(queue);
+            return;
+        }
+        QSharedPointer<QMozPayloadDecoderEntry> entry = queue->first();
+        if (!entry->done.loadAcquire()) {
+            return;
+        }
+        queue->removeFirst();
+        if (queue->isEmpty()) {
+            // Later messages of the channel may take the fast path again
+            mChannels.erase(queue);
+        }
+        mPending--;
+        entry->deliver(entry->data, entry->ok);
+    }
+}
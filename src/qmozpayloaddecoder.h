@@ -0,0 +1,69 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef QMOZPAYLOADDECODER_H
+#define QMOZPAYLOADDECODER_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QSharedPointer>
+#include <QString>
+#include <QVariant>
+#include <QThreadPool>
+#include <functional>
+
+class QMozJsonPayload;
+struct QMozPayloadDecoderEntry;
+
+/*!
+ * Decodes observer and message payloads into QVariants for the signals
+ * that need them. Payloads of at least threshold() characters are parsed
+ * on a worker thread so that the GUI thread keeps rendering, smaller
+ * ones synchronously. Results are delivered on the decoder's thread in
+ * call order per owner and channel: a small message queued behind a
+ * large one waits for it.
+ */
+class QMozPayloadDecoder : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef std::function<void(const QVariant& data, bool ok)> Callback;
+
+    explicit QMozPayloadDecoder(QObject *parent = 0);
+    virtual ~QMozPayloadDecoder();
+
+    // Characters, 0 decodes everything synchronously
+    void setThreshold(int threshold);
+    int threshold() const;
+
+    void decode(const void* owner, const QString& channel, QMozJsonPayload& payload, const Callback& deliver);
+    // Drops undelivered results of owner, to be called when it goes away
+    void cancel(const void* owner);
+
+    // Decodes started and not yet delivered
+    int pending() const;
+    // Payloads parsed on a worker thread so far
+    int offThreadDecodes() const;
+
+private Q_SLOTS:
+    void deliverFinished();
+
+private:
+    typedef QPair<const void*, QString> ChannelKey;
+    typedef QList<QSharedPointer<QMozPayloadDecoderEntry> > ChannelQueue;
+
+    void drain(const ChannelKey& key);
+
+    int mThreshold;
+    int mPending;
+    int mOffThreadDecodes;
+    QHash<ChannelKey, ChannelQueue> mChannels;
+    QThreadPool mPool;
+};
+
+#endif
@@ -0,0 +1,115 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "qmozpostqueue.h"
+
+QMozPostQueue::QMozPostQueue(int aCapacity)
+    : mHead(&mStub)
+    , mTail(&mStub)
+    , mStub(QMozPostItem::Observe, QString())
+    , mCapacity(qMax(aCapacity, 1))
+    , mDepth(0)
+    , mMaxDepth(0)
+    , mDrainScheduled(0)
+{
+}
+
+QMozPostQueue::~QMozPostQueue()
+{
+    while (QMozPostItem* item = pop()) {
+        delete item;
+    }
+}
+
+bool QMozPostQueue::tryPush(QMozPostItem* aItem)
+{
+    int depth = mDepth.fetchAndAddOrdered(1) + 1;
+    if (depth > mCapacity.load()) {
+        mDepth.deref();
+        return false;
+    }
+    int maxDepth = mMaxDepth.load();
+    while (depth > maxDepth && !mMaxDepth.testAndSetRelaxed(maxDepth, depth)) {
+        maxDepth = mMaxDepth.load();
+    }
+    link(aItem);
+    return true;
+}
+
+void QMozPostQueue::link(QMozPostItem* aItem)
+{
+    aItem->next.store(NULL);
+    QMozPostItem* previous = mHead.fetchAndStoreOrdered(aItem);
+    // Until this store the consumer sees the queue end at previous
+    previous->next.storeRelease(aItem);
+}
+
+QMozPostItem* QMozPostQueue::pop()
+{
+    QMozPostItem* tail = mTail;
+    QMozPostItem* next = tail->next.loadAcquire();
+    if (tail == &mStub) {
+        if (!next) {
+            return NULL;
+        }
+        mTail = next;
+        tail = next;
+        next = next->next.loadAcquire();
+    }
+    if (next) {
+        mTail = next;
+        mDepth.deref();
+        return tail;
+    }
+    if (tail != mHead.loadAcquire()) {
+        // A producer swapped in a new head and has not linked it yet
+        return NULL;
+    }
+    // tail is the last item, put the stub behind it so it can be handed out
+    link(&mStub);
+    next = tail->next.loadAcquire();
+    if (next) {
+        mTail = next;
+        mDepth.deref();
+        return tail;
+    }
+    return NULL;
+}
+
+bool QMozPostQueue::scheduleDrain()
+{
+    return mDrainScheduled.testAndSetOrdered(0, 1);
+}
+
+void QMozPostQueue::drainStarted()
+{
+    // Items pushed from here on schedule the next drain
+    mDrainScheduled.storeRelease(0);
+}
+
+void QMozPostQueue::setCapacity(int aCapacity)
+{
+    mCapacity.store(qMax(aCapacity, 1));
+}
+
+int QMozPostQueue::capacity() const
+{
+    return mCapacity.load();
+}
+
+int QMozPostQueue::depth() const
+{
+    return mDepth.load();
+}
+
+int QMozPostQueue::maxDepth() const
+{
+    return mMaxDepth.load();
+}
+
+void QMozPostQueue::resetMaxDepth()
+{
+    mMaxDepth.store(mDepth.load());
+}
@@ -0,0 +1,88 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef QMOZPOSTQUEUE_H
+#define QMOZPOSTQUEUE_H
+
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QString>
+#include <QVariant>
+
+/*!
+ * Observer notification, pref or view message posted from any thread,
+ * data already serialized by the posting thread.
+ */
+struct QMozPostItem
+{
+    enum Kind {
+        Observe,
+        Pref,
+        AsyncMessage
+    };
+
+    QMozPostItem(Kind aKind, const QString& aName)
+        : kind(aKind)
+        , name(aName)
+        , viewId(0)
+    {
+    }
+
+    Kind kind;
+    QString name;
+    // Serialized Observe and AsyncMessage data
+    QString data;
+    // Pref value
+    QVariant value;
+    quint32 viewId;
+    QAtomicPointer<QMozPostItem> next;
+};
+
+/*!
+ * Bounded lock-free multiple producer, single consumer queue of
+ * QMozPostItems (Vyukov's intrusive MPSC queue). Any thread may push,
+ * only the thread owning the queue pops. Pushing is wait-free apart
+ * from the depth reservation, popping never blocks.
+ */
+class QMozPostQueue
+{
+public:
+    explicit QMozPostQueue(int aCapacity = 4096);
+    ~QMozPostQueue();
+
+    // Any thread. Takes aItem, false leaves it with the caller when the
+    // queue holds capacity() items.
+    bool tryPush(QMozPostItem* aItem);
+    // Owning thread. NULL when empty, or while the next item is still
+    // being linked in by its producer; that producer schedules another
+    // drain after it is done.
+    QMozPostItem* pop();
+
+    // Any thread, returns true for exactly one caller until
+    // drainStarted() is called
+    bool scheduleDrain();
+    void drainStarted();
+
+    void setCapacity(int aCapacity);
+    int capacity() const;
+    // Items pushed and not yet popped
+    int depth() const;
+    int maxDepth() const;
+    void resetMaxDepth();
+
+private:
+    void link(QMozPostItem* aItem);
+
+    // Producers swap themselves in at the head, the consumer reads from the tail
+    QAtomicPointer<QMozPostItem> mHead;
+    QMozPostItem* mTail;
+    QMozPostItem mStub;
+    QAtomicInt mCapacity;
+    QAtomicInt mDepth;
+    QAtomicInt mMaxDepth;
+    QAtomicInt mDrainScheduled;
+};
+
+#endif
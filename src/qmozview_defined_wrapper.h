@@ -1,9 +1,20 @@
 #ifndef qmozview_defined_wrapper_h
 #define qmozview_defined_wrapper_h
 
+#include <QObject>
 #include <QVariant>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <functional>
 
 class QMozScrollDecorator;
+class QMozJsonPayload;
+
+// Per message name handler of view async messages, the payload is only
+// valid during the call
+typedef std::function<void(const QString& message, QMozJsonPayload* payload)> QMozMessageHandler;
 
 class QMozReturnValue : public QObject
 {
@@ -11,15 +22,161 @@ class QMozReturnValue : public QObject
     Q_PROPERTY(QVariant message READ getMessage WRITE setMessage FINAL)
 
 public:
-    QMozReturnValue(QObject* parent = 0) : QObject(parent) {}
-    QMozReturnValue(const QMozReturnValue& aMsg) : QObject(NULL) { mMessage = aMsg.mMessage; }
+    enum ReplyType {
+        VariantReply,
+        JsonReply,
+        StringReply,
+        NumberReply,
+        BoolReply
+    };
+
+    QMozReturnValue(QObject* parent = 0) : QObject(parent), mType(VariantReply), mNumber(0), mDeferred(false), mReleased(false), mAnswered(false), mExpired(false) {}
+    QMozReturnValue(const QMozReturnValue& aMsg) : QObject(NULL), mReleased(false), mAnswered(false), mExpired(false) { mMessage = aMsg.mMessage; mType = aMsg.mType; mText = aMsg.mText; mNumber = aMsg.mNumber; mDeferred = false; }
     virtual ~QMozReturnValue() {}
 
-    QVariant getMessage() const { return mMessage; }
-    void setMessage(const QVariant& msg) { mMessage = msg; }
+    QVariant getMessage() const
+    {
+        switch (mType) {
+        case JsonReply:
+        case StringReply:
+            return mText;
+        case NumberReply:
+            return mNumber;
+        case BoolReply:
+            return mNumber != 0;
+        default:
+            return mMessage;
+        }
+    }
+    void setMessage(const QVariant& msg)
+    {
+        QMutexLocker locker(&mMutex);
+        if (acceptReply(locker)) {
+            mMessage = msg;
+            setReply(VariantReply);
+        }
+    }
+
+    // Typed replies, kept as plain values and written into the reply
+    // buffer by QMozContext::serializeReplyUtf8()
+    Q_INVOKABLE void setString(const QString& aValue)
+    {
+        QMutexLocker locker(&mMutex);
+        if (acceptReply(locker)) {
+            mText = aValue;
+            setReply(StringReply);
+        }
+    }
+    Q_INVOKABLE void setNumber(double aValue)
+    {
+        QMutexLocker locker(&mMutex);
+        if (acceptReply(locker)) {
+            mNumber = aValue;
+            setReply(NumberReply);
+        }
+    }
+    Q_INVOKABLE void setBool(bool aValue)
+    {
+        QMutexLocker locker(&mMutex);
+        if (acceptReply(locker)) {
+            mNumber = aValue ? 1 : 0;
+            setReply(BoolReply);
+        }
+    }
+    // Reply that is already JSON text, passed to Gecko as is
+    Q_INVOKABLE void setJson(const QString& aJson)
+    {
+        QMutexLocker locker(&mMutex);
+        if (acceptReply(locker)) {
+            mText = aJson;
+            setReply(JsonReply);
+        }
+    }
+    bool isJson() const { return mType == JsonReply; }
+
+    ReplyType replyType() const { return mType; }
+    // Value of a string or JSON reply
+    const QString& text() const { return mText; }
+    double number() const { return mNumber; }
+
+    // C++ only: a sync message handler calls defer() to answer after
+    // returning, with any of the setters above, from another thread. The
+    // GUI thread blocks in waitForAnswer() for up to the context's sync
+    // message deadline without running an event loop, so neither QML nor
+    // anything else living on the GUI thread can answer a deferred reply.
+    void defer() { mDeferred = true; }
+    bool deferred() const { return mDeferred; }
+    bool answered() const { return mAnswered.load(); }
+    // Waits until a deferred reply is answered or aMsec have passed.
+    // Returns whether it was answered.
+    bool waitForAnswer(int aMsec)
+    {
+        QMutexLocker locker(&mMutex);
+        QElapsedTimer waited;
+        waited.start();
+        while (!mAnswered.load() && waited.elapsed() < aMsec) {
+            mAnswer.wait(&mMutex, aMsec - waited.elapsed());
+        }
+        return mAnswered.load();
+    }
+    // Called by the owner once the reply is no longer needed. Answered
+    // and plain replies are freed right away. A deferred reply that is
+    // still unanswered expires, later answers are dropped and the first
+    // of them frees the object, so a deferring handler must answer.
+    void release()
+    {
+        QMutexLocker locker(&mMutex);
+        if (mDeferred && !mAnswered.load()) {
+            mExpired.store(1);
+            return;
+        }
+        // Taking the lock waited for an answering thread to leave
+        locker.unlock();
+        deleteLater();
+    }
+
+Q_SIGNALS:
+    void replied();
 
 private:
+    // Called with mMutex held, rejects answers to an answered or expired
+    // reply. The first answer to an expired one frees it.
+    bool acceptReply(QMutexLocker& aLocker)
+    {
+        if (mExpired.load()) {
+            if (!mReleased) {
+                mReleased = true;
+                aLocker.unlock();
+                deleteLater();
+            }
+            return false;
+        }
+        return !mAnswered.load();
+    }
+
+    // Called with mMutex held. replied() is emitted under the lock too,
+    // release() waits for it, so directly connected receivers must not
+    // call the setters.
+    void setReply(ReplyType aType)
+    {
+        mType = aType;
+        if (mDeferred) {
+            mAnswered.store(1);
+            mAnswer.wakeAll();
+            Q_EMIT replied();
+        }
+    }
+
     QVariant mMessage;
+    ReplyType mType;
+    QString mText;
+    double mNumber;
+    bool mDeferred;
+    bool mReleased;
+    QAtomicInt mAnswered;
+    QAtomicInt mExpired;
+    QMutex mMutex;
+    QWaitCondition mAnswer;
 };
 
 Q_DECLARE_METATYPE(QMozReturnValue)
@@ -95,7 +252,9 @@ Q_DECLARE_METATYPE(QMozReturnValue) \
     bool chrome() const; \
     void setChrome(bool value); \
     qreal chromeGestureThreshold() const; \
-    void setChromeGestureThreshold(qreal value);
+    void setChromeGestureThreshold(qreal value); \
+    int registerMessageHandler(const QString& message, const QMozMessageHandler& handler); \
+    void unregisterMessageHandler(int id);
 
 #define Q_MOZ_VIEW_PUBLIC_SLOTS \
     void loadHtml(const QString& html, const QUrl& baseUrl = QUrl()); \
@@ -105,6 +264,7 @@ Q_DECLARE_METATYPE(QMozReturnValue) \
     void reload(); \
     void load(const QString&); \
     void sendAsyncMessage(const QString& name, const QVariant& variant); \
+    void sendAsyncMessages(const QVariantList& messages); \
     void addMessageListener(const QString& name); \
     void addMessageListeners(const QStringList& messageNamesList); \
     void loadFrameScript(const QString& name); \
@@ -133,7 +293,9 @@ Q_DECLARE_METATYPE(QMozReturnValue) \
     void viewDestroyed(); \
     void windowCloseRequested(); \
     void recvAsyncMessage(const QString message, const QVariant data); \
+    void recvAsyncMessagePayload(const QString message, QMozJsonPayload* payload); \
     bool recvSyncMessage(const QString message, const QVariant data, QMozReturnValue* response); \
+    void recvSyncMessagePayload(const QString message, QMozJsonPayload* payload, QMozReturnValue* response); \
     void loadRedirect(); \
     void securityChanged(QString status, uint state); \
     void firstPaint(int offx, int offy); \
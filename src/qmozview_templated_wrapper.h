@@ -7,13 +7,18 @@
 #ifndef qmozview_templated_wrapper_h
 #define qmozview_templated_wrapper_h
 
+#include <QMetaMethod>
+
 class QPoint;
 class QString;
 class QMozReturnValue;
+class QMozJsonPayload;
 class IMozQViewIface
 {
 public:
     virtual ~IMozQViewIface() {}
+    // The QuickMozView/QGraphicsMozView wrapped
+    virtual QObject* viewObject() = 0;
     // Methods
     virtual void CompositingFinished() = 0;
     virtual void setInputMethodHints(Qt::InputMethodHints hints) = 0;
@@ -31,7 +36,13 @@ public:
     virtual void viewDestroyed() = 0;
     virtual void windowCloseRequested() = 0;
     virtual void recvAsyncMessage(const QString message, const QVariant data) = 0;
+    virtual void recvAsyncMessagePayload(const QString message, QMozJsonPayload* payload) = 0;
+    // Something is connected to recvAsyncMessage(), the data has to be parsed
+    virtual bool hasAsyncMessageReceivers() = 0;
+    virtual bool hasAsyncMessagePayloadReceivers() = 0;
     virtual bool recvSyncMessage(const QString message, const QVariant data, QMozReturnValue* response) = 0;
+    virtual void recvSyncMessagePayload(const QString message, QMozJsonPayload* payload, QMozReturnValue* response) = 0;
+    virtual bool hasSyncMessageReceivers() = 0;
     virtual void loadRedirect() = 0;
     virtual void securityChanged(QString status, uint state) = 0;
     virtual void firstPaint(int offx, int offy) = 0;
@@ -58,6 +69,11 @@ class IMozQView : public IMozQViewIface
 public:
     IMozQView(TMozQView& aView) : view(aView) {}
 
+    QObject* viewObject()
+    {
+        return &view;
+    }
+
     void CompositingFinished()
     {
         view.CompositingFinished();
@@ -115,10 +131,30 @@ public:
     {
         Q_EMIT view.recvAsyncMessage(message, data);
     }
+    void recvAsyncMessagePayload(const QString message, QMozJsonPayload* payload)
+    {
+        Q_EMIT view.recvAsyncMessagePayload(message, payload);
+    }
+    bool hasAsyncMessageReceivers()
+    {
+        return view.isSignalConnected(QMetaMethod::fromSignal(&TMozQView::recvAsyncMessage));
+    }
+    bool hasAsyncMessagePayloadReceivers()
+    {
+        return view.isSignalConnected(QMetaMethod::fromSignal(&TMozQView::recvAsyncMessagePayload));
+    }
     bool recvSyncMessage(const QString message, const QVariant data, QMozReturnValue* response)
     {
         return Q_EMIT view.recvSyncMessage(message, data, response);
     }
+    void recvSyncMessagePayload(const QString message, QMozJsonPayload* payload, QMozReturnValue* response)
+    {
+        Q_EMIT view.recvSyncMessagePayload(message, payload, response);
+    }
+    bool hasSyncMessageReceivers()
+    {
+        return view.isSignalConnected(QMetaMethod::fromSignal(&TMozQView::recvSyncMessage));
+    }
     void loadRedirect()
     {
         Q_EMIT view.loadRedirect();
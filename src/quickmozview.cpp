@@ -28,6 +28,7 @@
 #include "qgraphicsmozview_p.h"
 #include "EmbedQtKeyUtils.h"
 #include "qmozscrolldecorator.h"
+#include "qmozjsonpayload.h"
 #include "qmoztexturenode.h"
 #include "qmozextmaterialnode.h"
 #include "assert.h"
@@ -83,6 +84,7 @@ QuickMozView::~QuickMozView()
 {
     QMutexLocker locker(&mRenderMutex);
 
+    d->mContext->setViewInteractive(this, false);
     if (d->mView) {
         d->mView->SetListener(NULL);
         d->mContext->GetApp()->DestroyView(d->mView);
@@ -96,6 +98,7 @@ QuickMozView::SetIsActive(bool aIsActive)
 {
     if (QThread::currentThread() == thread() && d->mView) {
         d->mView->SetIsActive(aIsActive);
+        d->mContext->setViewInteractive(this, aIsActive && !mBackground);
         if (mActive) {
             updateGLContextInfo();
             d->UpdateViewSize();
@@ -200,6 +203,7 @@ void QuickMozView::itemChange(ItemChange change, const ItemChangeData &)
         connect(win, SIGNAL(sceneGraphInvalidated()), this, SLOT(clearThreadRenderObject()), Qt::DirectConnection);
         connect(win, SIGNAL(visibleChanged(bool)), this, SLOT(windowVisibleChanged(bool)));
         win->setClearBeforeRendering(false);
+        d->mContext->setIdleFrameWindow(win);
     }
 }
 
@@ -247,12 +251,30 @@ void QuickMozView::clearThreadRenderObject()
 
 void QuickMozView::createView()
 {
-    if (!d->mView) {
+    // Views made while libxul loads (QMozContext::setLoadAsynchronously())
+    // are created from contextInitialized()
+    if (!d->mView && d->mContext->GetApp()) {
+        d->mContext->recordStartupPhase(QStringLiteral("createView"));
+        // Gecko links a view to its opener at creation, views opened by a
+        // page (window.open(), QMozViewCreator) always get a fresh one
+        if (!mParentID && (d->mView = d->mContext->takeSpareView())) {
+            d->mView->SetListener(d);
+            // Already initialized, ViewInitialized() will not come again
+            QMetaObject::invokeMethod(this, "spareViewAdopted", Qt::QueuedConnection);
+            return;
+        }
         d->mView = d->mContext->GetApp()->CreateView(mParentID);
         d->mView->SetListener(d);
     }
 }
 
+void QuickMozView::spareViewAdopted()
+{
+    if (d->mView && !d->mViewInitialized) {
+        d->ViewInitialized();
+    }
+}
+
 QSGNode*
 QuickMozView::updatePaintNode(QSGNode* oldNode, UpdatePaintNodeData* data)
 {
@@ -356,6 +378,7 @@ bool QuickMozView::loaded() const
 
 void QuickMozView::CompositingFinished()
 {
+    d->mContext->notifyCompositingFinished();
     Q_EMIT dispatchItemUpdate();
 }
 
@@ -719,30 +742,33 @@ void QuickMozView::sendAsyncMessage(const QString& name, const QVariant& variant
     if (!d->mViewInitialized)
         return;
 
-    QJsonDocument doc = QJsonDocument::fromVariant(variant);
-    QByteArray array = doc.toJson();
+    const QString& data = d->mContext->serializeMessage(variant);
+    d->mView->SendAsyncMessage((const char16_t*)name.constData(), (const char16_t*)data.constData());
+}
 
-    d->mView->SendAsyncMessage((const char16_t*)name.constData(), NS_ConvertUTF8toUTF16(array.constData()).get());
+void QuickMozView::sendAsyncMessages(const QVariantList& messages)
+{
+    d->SendAsyncMessages(messages);
 }
 
 void QuickMozView::addMessageListener(const QString& name)
 {
-    if (!d->mViewInitialized)
-        return;
-
-    d->mView->AddMessageListener(name.toUtf8().data());
+    d->AddMessageListeners(QStringList() << name);
 }
 
 void QuickMozView::addMessageListeners(const QStringList& messageNamesList)
 {
-    if (!d->mViewInitialized)
-        return;
+    d->AddMessageListeners(messageNamesList);
+}
 
-    nsTArray<nsString> messages;
-    for (int i = 0; i < messageNamesList.size(); i++) {
-        messages.AppendElement((char16_t*)messageNamesList.at(i).data());
-    }
-    d->mView->AddMessageListeners(messages);
+int QuickMozView::registerMessageHandler(const QString& message, const QMozMessageHandler& handler)
+{
+    return d->RegisterMessageHandler(message, handler);
+}
+
+void QuickMozView::unregisterMessageHandler(int id)
+{
+    d->UnregisterMessageHandler(id);
 }
 
 void QuickMozView::loadFrameScript(const QString& name)
@@ -939,6 +965,7 @@ void QuickMozView::timerEvent(QTimerEvent *event)
             // mWindowVisible == mBackground visibility changed
             if (windowVisible == mWindowVisible && mWindowVisible == mBackground) {
                 mBackground = !mWindowVisible;
+                d->mContext->setViewInteractive(this, mActive && !mBackground);
                 Q_EMIT backgroundChanged();
                 if (mWindowVisible) {
                     killTimer(mBackgroundTimerId);
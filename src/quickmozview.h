@@ -13,6 +13,7 @@
 #include "qmozview_defined_wrapper.h"
 
 class QGraphicsMozViewPrivate;
+template<class TMozQView> class IMozQView;
 class QuickMozView : public QQuickItem
 {
     Q_OBJECT
@@ -97,12 +98,14 @@ private Q_SLOTS:
     void updateEnabled();
     void refreshNodeTexture();
     void windowVisibleChanged(bool visible);
+    void spareViewAdopted();
 
 private:
     void createView();
 
     QGraphicsMozViewPrivate* d;
     friend class QGraphicsMozViewPrivate;
+    friend class IMozQView<QuickMozView>;
     unsigned mParentID;
     bool mUseQmlMouse;
     int mMovingTimerId;
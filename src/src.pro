@@ -18,23 +18,35 @@ isEmpty(VERSION) {
 
 SOURCES += qmozcontext.cpp \
            qmozscrolldecorator.cpp \
+           qmozobserver.cpp \
+           qmozjsonpayload.cpp \
+           qmozmessageserializer.cpp \
+           qmozpayloaddecoder.cpp \
+           qmozpostqueue.cpp \
            qmessagepump.cpp \
            EmbedQtKeyUtils.cpp \
            qgraphicsmozview_p.cpp \
-           geckoworker.cpp
+           geckoworker.cpp \
+           geckowatchdog.cpp
 
 HEADERS += qmozcontext.h \
            qmozviewcreator.h \
            qmozscrolldecorator.h \
+           qmozobserver.h \
+           qmozjsonpayload.h \
+           qmozmessageserializer.h \
+           qmozpayloaddecoder.h \
+           qmozpostqueue.h \
            qmessagepump.h \
            EmbedQtKeyUtils.h \
            qgraphicsmozview_p.h \
            geckoworker.h \
+           geckowatchdog.h \
            qmozview_defined_wrapper.h \
            qmozview_templated_wrapper.h
 
-SOURCES += quickmozview.cpp qmoztexturenode.cpp qmozextmaterialnode.cpp
-HEADERS += quickmozview.h qmoztexturenode.h qmozextmaterialnode.h
+SOURCES += quickmozview.cpp qmoztexturenode.cpp qmozextmaterialnode.cpp qmozmessagelistener.cpp
+HEADERS += quickmozview.h qmoztexturenode.h qmozextmaterialnode.h qmozmessagelistener.h
 
 !isEmpty(BUILD_QT5QUICK1) {
   SOURCES += qdeclarativemozview.cpp qgraphicsmozview.cpp
@@ -71,4 +83,11 @@ FORWARDING_HEADERS = $$system( find q*.h )
 
 forwarding_headers.path = $$PREFIX/include
 forwarding_headers.files = $$FORWARDING_HEADERS
-INSTALLS += forwarding_headers target
+
+# chrome://qtmozembed/, registered by QMozContext once Gecko is up
+chrome.path = $$PREFIX/share/qtmozembed/chrome
+chrome.files = chrome/*
+DEFINES += QTMOZEMBED_CHROME_MANIFEST=\"\\\"$$chrome.path/QtMozEmbed.manifest\\\"\"
+OTHER_FILES += chrome/QtMozEmbed.manifest chrome/content/*.js
+
+INSTALLS += forwarding_headers target chrome
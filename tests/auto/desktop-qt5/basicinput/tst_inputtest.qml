@@ -96,5 +96,10 @@ Item {
         {
             SharedTests.shared_Test1LoadInputURLPage()
         }
+
+        function test_Test2BroadcastAsyncMessage()
+        {
+            SharedTests.shared_Test2BroadcastAsyncMessage()
+        }
     }
 }
@@ -11,11 +11,26 @@ Item {
 
     property bool mozViewInitialized : false
     property variant mozView : null
+    property int createParentID : 0
     property variant lastObserveMessage
+    property variant routedObserveMessages: []
+    property string routedPayloadMessage
 
     QmlMozContext {
         id: mozContext
     }
+    MozObserver {
+        topic: "test-routed-message"
+        onReceived: {
+            routedObserveMessages = routedObserveMessages.concat([{ msg: topic, data: data }])
+        }
+    }
+    MozObserver {
+        topic: "test-routed-message"
+        onPayloadReceived: {
+            routedPayloadMessage = payload.string("msg")
+        }
+    }
     Connections {
         target: mozContext.instance
         onOnInitialized: {
@@ -55,5 +70,25 @@ Item {
         {
             SharedTests.shared_context4ObserveAPI()
         }
+        function test_context5ObserverRouting()
+        {
+            SharedTests.shared_context5ObserverRouting()
+        }
+        function test_context6ObserverRefCount()
+        {
+            SharedTests.shared_context6ObserverRefCount()
+        }
+        function test_context7PrefBatch()
+        {
+            SharedTests.shared_context7PrefBatch()
+        }
+        function test_context8StartupTimeline()
+        {
+            SharedTests.shared_context8StartupTimeline()
+        }
+        function test_context9SpareViewPool()
+        {
+            SharedTests.shared_context9SpareViewPool()
+        }
     }
 }
@@ -0,0 +1,103 @@
+import QtTest 1.0
+import QtQuick 2.0
+import Qt5Mozilla 1.0
+import "../../shared/componentCreation.js" as MyScript
+import "../../shared/sharedTests.js" as SharedTests
+
+Item {
+    id: appWindow
+    width: 480
+    height: 800
+
+    property bool mozViewInitialized : false
+    property bool earlyViewInitialized : false
+    property bool earlyListenerQueued : false
+    property variant listenerFavicon : null
+    property variant earlyFavicon : null
+
+    QmlMozContext {
+        id: mozContext
+    }
+    Connections {
+        target: mozContext.instance
+        onOnInitialized: {
+            // Gecko does not switch to SW mode if gl context failed to init
+            // and qmlmoztestrunner does not build in GL mode
+            // Let's put it here for now in SW mode always
+            mozContext.instance.setIsAccelerated(true);
+            mozContext.instance.addComponentManifest(mozContext.getenv("QTTESTSROOT") + "/components/TestHelpers.manifest");
+        }
+    }
+
+    // Only gets chrome:linkadded through MozMessageListener
+    QmlMozView {
+        id: webViewport
+        visible: true
+        focus: true
+        active: true
+        width: parent.width
+        height: parent.height / 2
+        Connections {
+            target: webViewport.child
+            onViewInitialized: {
+                appWindow.mozViewInitialized = true
+            }
+        }
+    }
+    MozMessageListener {
+        view: webViewport
+        message: "chrome:linkadded"
+        onPayloadReceived: {
+            print("onPayloadReceived:" + message + ", data:" + payload.raw)
+            if (payload.string("get") == "image/x-icon") {
+                appWindow.listenerFavicon = payload.string("href");
+            }
+        }
+    }
+
+    // Subscribes with addMessageListener() before it is initialized
+    QmlMozView {
+        id: earlyViewport
+        visible: true
+        active: true
+        y: parent.height / 2
+        width: parent.width
+        height: parent.height / 2
+        Component.onCompleted: {
+            appWindow.earlyListenerQueued = !appWindow.earlyViewInitialized;
+            earlyViewport.child.addMessageListener("chrome:linkadded");
+        }
+        Connections {
+            target: earlyViewport.child
+            onViewInitialized: {
+                appWindow.earlyViewInitialized = true
+            }
+            onRecvAsyncMessage: {
+                print("onRecvAsyncMessage:" + message + ", data:" + data)
+                if (message == "chrome:linkadded" && data.get == "image/x-icon") {
+                    appWindow.earlyFavicon = data.href;
+                }
+            }
+        }
+    }
+
+    resources: TestCase {
+        id: testcaseid
+        name: "mozMessageListener"
+        when: windowShown
+        parent: appWindow
+
+        function cleanup() {
+            mozContext.dumpTS("tst_messagelistener cleanup")
+        }
+
+        function test_TestMessageListener()
+        {
+            SharedTests.shared_TestMessageListener()
+        }
+        function test_TestQueuedMessageListener()
+        {
+            SharedTests.shared_TestQueuedMessageListener()
+        }
+    }
+}
@@ -51,6 +51,121 @@ function shared_context4ObserveAPI()
     testcaseid.compare(lastObserveMessage.data.msg, "testMessage");
     mozContext.dumpTS("test_context4ObserveAPI end")
 }
+function shared_context5ObserverRouting()
+{
+    mozContext.dumpTS("test_context5ObserverRouting start")
+    appWindow.routedObserveMessages = []
+    appWindow.routedPayloadMessage = ""
+    mozContext.instance.addObserver("test-unrouted-message");
+    mozContext.instance.sendObserve("test-unrouted-message", {msg: "unrouted"});
+    mozContext.instance.sendObserve("test-routed-message", {msg: "routed", val: 2});
+    testcaseid.verify(wrtWait(function() { return (routedObserveMessages.length === 0); }))
+    testcaseid.compare(routedObserveMessages.length, 1);
+    testcaseid.compare(routedObserveMessages[0].msg, "test-routed-message");
+    testcaseid.compare(routedObserveMessages[0].data.msg, "routed");
+    testcaseid.compare(routedObserveMessages[0].data.val, 2);
+    testcaseid.compare(routedPayloadMessage, "routed");
+    mozContext.dumpTS("test_context5ObserverRouting end")
+}
+function shared_context6ObserverRefCount()
+{
+    mozContext.dumpTS("test_context6ObserverRefCount start")
+    var topics = mozContext.instance.observedTopicCount();
+    mozContext.instance.addObserver("test-refcount-message");
+    mozContext.instance.addObserver("test-refcount-message");
+    testcaseid.compare(mozContext.instance.observedTopicCount(), topics + 1);
+    mozContext.instance.removeObserver("test-refcount-message");
+    appWindow.lastObserveMessage = undefined
+    mozContext.instance.sendObserve("test-refcount-message", {msg: "stillObserved"});
+    testcaseid.verify(wrtWait(function() { return (lastObserveMessage === undefined); }))
+    testcaseid.compare(lastObserveMessage.data.msg, "stillObserved");
+
+    mozContext.instance.removeObserver("test-refcount-message");
+    testcaseid.compare(mozContext.instance.observedTopicCount(), topics);
+    appWindow.lastObserveMessage = undefined
+    mozContext.instance.sendObserve("test-refcount-message", {msg: "dropped"});
+    testcaseid.verify(!wrtWait(function() { return (lastObserveMessage === undefined); }, 10, 100))
+
+    // Unbalanced removals are ignored
+    mozContext.instance.removeObserver("test-refcount-message");
+    testcaseid.compare(mozContext.instance.observedTopicCount(), topics);
+
+    mozContext.instance.addObservers(["test-refcount-a", "test-refcount-b", "test-refcount-a"]);
+    testcaseid.compare(mozContext.instance.observedTopicCount(), topics + 2);
+    mozContext.instance.removeObservers(["test-refcount-a", "test-refcount-b"]);
+    testcaseid.compare(mozContext.instance.observedTopicCount(), topics + 1);
+    mozContext.instance.removeObserver("test-refcount-a");
+    testcaseid.compare(mozContext.instance.observedTopicCount(), topics);
+    mozContext.dumpTS("test_context6ObserverRefCount end")
+}
+function shared_context7PrefBatch()
+{
+    mozContext.dumpTS("test_context7PrefBatch start")
+    testcaseid.compare(mozContext.instance.pendingPrefCount(), 0);
+    mozContext.instance.beginPrefBatch();
+    mozContext.instance.setPref("test.embedlite.batch.int", 1);
+    mozContext.instance.setPref("test.embedlite.batch.int", 2);
+    mozContext.instance.setPrefs({"test.embedlite.batch.int": 3,
+                                  "test.embedlite.batch.bool": true,
+                                  "test.embedlite.batch.float": 0.5});
+    testcaseid.compare(mozContext.instance.pendingPrefCount(), 3);
+    mozContext.instance.commitPrefBatch();
+    testcaseid.compare(mozContext.instance.pendingPrefCount(), 0);
+    mozContext.instance.setPrefs({"test.embedlite.batch.string": "result"});
+    testcaseid.compare(mozContext.instance.pendingPrefCount(), 0);
+    mozContext.dumpTS("test_context7PrefBatch end")
+}
+function shared_context8StartupTimeline()
+{
+    mozContext.dumpTS("test_context8StartupTimeline start")
+    var timeline = mozContext.instance.startupTimeline();
+    var phases = timeline.map(function(entry) { return entry.phase; });
+    testcaseid.compare(phases[0], "contextCreated");
+    testcaseid.verify(phases.indexOf("embedLiteLoaded") > 0);
+    testcaseid.verify(phases.indexOf("initialized") > phases.indexOf("embedLiteAppCreated"));
+    for (var i = 1; i < timeline.length; ++i) {
+        testcaseid.verify(timeline[i].usec >= timeline[i - 1].usec);
+    }
+    var dump = JSON.parse(mozContext.instance.startupTimelineJson());
+    testcaseid.compare(dump.phases.length, timeline.length);
+    testcaseid.verify(dump.originMsec > 0);
+    mozContext.dumpTS("test_context8StartupTimeline end")
+}
+function shared_context9SpareViewPool()
+{
+    mozContext.dumpTS("test_context9SpareViewPool start")
+    mozContext.instance.resetSpareViewStatistics();
+    mozContext.instance.setSpareViewPoolSize(1);
+    testcaseid.compare(mozContext.instance.spareViewPoolSize(), 1);
+    testcaseid.verify(wrtWait(function() { return (mozContext.instance.spareViewStatistics().ready < 1); }, 5000, 10))
+    var statistics = mozContext.instance.spareViewStatistics();
+    testcaseid.compare(statistics.hits, 0);
+    testcaseid.compare(statistics.misses, 0);
+    testcaseid.compare(statistics.hitRate, 0);
+
+    // A new top level view adopts the ready spare
+    appWindow.createParentID = 0;
+    MyScript.createSpriteObjectsQt5();
+    testcaseid.verify(wrtWait(function() { return (appWindow.mozView === null); }, 10, 500))
+    testcaseid.verify(wrtWait(function() { return (appWindow.mozViewInitialized !== true); }, 10, 500))
+    statistics = mozContext.instance.spareViewStatistics();
+    testcaseid.compare(statistics.hits, 1);
+    testcaseid.compare(statistics.misses, 0);
+    testcaseid.compare(statistics.hitRate, 1);
+    testcaseid.verify(statistics.savedMsec > 0);
+    appWindow.mozView.child.url = "about:mozilla";
+    testcaseid.verify(MyScript.waitLoadFinished(appWindow.mozView))
+    testcaseid.compare(appWindow.mozView.child.url, "about:mozilla")
+    testcaseid.verify(wrtWait(function() { return (!appWindow.mozView.child.painted); }))
+
+    // Refilled in the background after the adoption
+    testcaseid.verify(wrtWait(function() { return (mozContext.instance.spareViewStatistics().ready < 1); }, 5000, 10))
+    mozContext.instance.setSpareViewPoolSize(0);
+    testcaseid.compare(mozContext.instance.spareViewStatistics().ready, 0);
+    appWindow.mozView.destroy();
+    appWindow.mozView = null;
+    mozContext.dumpTS("test_context9SpareViewPool end")
+}
 function shared_Test1LoadInputPage()
 {
     mozContext.dumpTS("test_Test1LoadInputPage start")
@@ -104,6 +219,24 @@ function shared_Test1LoadInputURLPage()
     mozContext.dumpTS("test_Test1LoadInputPage end");
 }
 
+function shared_Test2BroadcastAsyncMessage()
+{
+    mozContext.dumpTS("test_Test2BroadcastAsyncMessage start")
+    testcaseid.verify(MyScript.waitMozContext())
+    testcaseid.verify(MyScript.waitMozView())
+    testcaseid.compare(mozContext.instance.viewCount(), 1);
+    appWindow.inputContent = ""
+    webViewport.child.url = "data:text/html,<body><input id=myelem value='broadcast'>";
+    testcaseid.verify(MyScript.waitLoadFinished(webViewport))
+    mozContext.instance.broadcastAsyncMessage("embedtest:getelementprop", {
+                                               name: "myelem",
+                                               property: "value"
+                                              })
+    testcaseid.verify(wrtWait(function() { return (appWindow.inputContent == ""); }))
+    testcaseid.compare(appWindow.inputContent, "broadcast");
+    mozContext.dumpTS("test_Test2BroadcastAsyncMessage end");
+}
+
 function shared_TestScrollPaintOperations()
 {
     mozContext.dumpTS("test_TestScrollPaintOperations start")
@@ -202,6 +335,55 @@ function shared_TestFaviconPage()
     mozContext.dumpTS("test_TestFaviconPage");
 }
 
+function shared_TestMessageListener()
+{
+    mozContext.dumpTS("test_TestMessageListener start")
+    testcaseid.verify(MyScript.waitMozContext())
+    testcaseid.verify(MyScript.waitMozView())
+    webViewport.child.url = mozContext.getenv("QTTESTSROOT") + "/auto/shared/favicons/favicon.html";
+    testcaseid.verify(MyScript.waitLoadFinished(webViewport))
+    testcaseid.verify(wrtWait(function() { return (!appWindow.listenerFavicon); }))
+    testcaseid.verify(appWindow.listenerFavicon.indexOf("data:image/x-icon;base64,") === 0)
+    mozContext.dumpTS("test_TestMessageListener end")
+}
+
+function shared_TestQueuedMessageListener()
+{
+    mozContext.dumpTS("test_TestQueuedMessageListener start")
+    testcaseid.verify(appWindow.earlyListenerQueued)
+    testcaseid.verify(MyScript.waitMozContext())
+    testcaseid.verify(wrtWait(function() { return (!appWindow.earlyViewInitialized); }))
+    earlyViewport.child.url = mozContext.getenv("QTTESTSROOT") + "/auto/shared/favicons/favicon.html";
+    testcaseid.verify(MyScript.waitLoadFinished(earlyViewport))
+    testcaseid.verify(wrtWait(function() { return (!appWindow.earlyFavicon); }))
+    testcaseid.verify(appWindow.earlyFavicon.indexOf("data:image/x-icon;base64,") === 0)
+    mozContext.dumpTS("test_TestQueuedMessageListener end")
+}
+
+function shared_TestMessageBatchDelivery()
+{
+    mozContext.dumpTS("test_TestMessageBatchDelivery start")
+    testcaseid.verify(MyScript.waitMozContext())
+    testcaseid.verify(MyScript.waitMozView())
+    // MessageBatch.js hands the first one to testHelper.js, the weak
+    // listener only gets its message once the view sends it again
+    webViewport.child.sendAsyncMessages([{name: "embedtest:batchecho", data: {value: 1}},
+                                         {name: "embedtest:weakecho", data: {value: 2}},
+                                         {name: "embedtest:batchecho", data: {value: 3}}]);
+    testcaseid.verify(wrtWait(function() { return (appWindow.batchEchoes.length < 3); }))
+    testcaseid.compare(appWindow.batchEchoes.length, 3);
+    testcaseid.verify(appWindow.batchEchoes.indexOf("embedtest:batchecho:1") >= 0)
+    testcaseid.verify(appWindow.batchEchoes.indexOf("embedtest:weakecho:2") >= 0)
+    testcaseid.verify(appWindow.batchEchoes.indexOf("embedtest:batchecho:1") < appWindow.batchEchoes.indexOf("embedtest:batchecho:3"))
+    // From now on the weak listener's messages are not batched, in order
+    webViewport.child.sendAsyncMessages([{name: "embedtest:weakecho", data: {value: 4}},
+                                         {name: "embedtest:batchecho", data: {value: 5}},
+                                         {name: "embedtest:batchecho", data: {value: 6}}]);
+    testcaseid.verify(wrtWait(function() { return (appWindow.batchEchoes.length < 6); }))
+    testcaseid.compare(appWindow.batchEchoes.slice(3), ["embedtest:weakecho:4", "embedtest:batchecho:5", "embedtest:batchecho:6"]);
+    mozContext.dumpTS("test_TestMessageBatchDelivery end")
+}
+
 function shared_Test1MultiTouchPage()
 {
     mozContext.dumpTS("test_Test1MultiTouchPage start")
@@ -0,0 +1,23 @@
+TEMPLATE = app
+TARGET = tst_context
+CONFIG += warn_on testcase
+QT += testlib quick
+
+SOURCES += tst_context.cpp
+
+RELATIVE_PATH=../../../..
+VDEPTH_PATH=tests/auto/unit/context
+include($$RELATIVE_PATH/relative-objdir.pri)
+
+# Runs the library against the installed Gecko, like qmlmoztestrunner
+INCLUDEPATH+=$$RELATIVE_PATH/src
+LIBS+= -L$$RELATIVE_PATH/$$OBJ_BUILD_PATH/src -lqt5embedwidget
+
+isEmpty(DEFAULT_COMPONENT_PATH) {
+  DEFINES += DEFAULT_COMPONENTS_PATH=\"\\\"/usr/lib/mozembedlite/\\\"\"
+} else {
+  DEFINES += DEFAULT_COMPONENTS_PATH=\"\\\"$$DEFAULT_COMPONENT_PATH\\\"\"
+}
+
+target.path = /opt/tests/qtmozembed/unit
+INSTALLS += target
@@ -0,0 +1,240 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <QtTest/QtTest>
+#include <QPointer>
+
+#include "qmozcontext.h"
+#include "geckowatchdog.h"
+
+/*
+ * Worker thread posting observer notifications and prefs through the
+ * context's thread safe post*() calls.
+ */
+class Poster : public QThread
+{
+public:
+    Poster(QMozContext* aContext, int aIndex, int aCount)
+        : rejected(0)
+        , mContext(aContext)
+        , mIndex(aIndex)
+        , mCount(aCount)
+    {
+    }
+
+    int rejected;
+
+protected:
+    virtual void run()
+    {
+        for (int i = 0; i < mCount; ++i) {
+            QVariantMap data;
+            data.insert("poster", mIndex);
+            data.insert("sequence", i);
+            if (!mContext->postObserve("test-postqueue-message", QVariant(data))) {
+                rejected++;
+            }
+            if (!mContext->postPref(QString("embedlite.test.postqueue.%1").arg(mIndex), i)) {
+                rejected++;
+            }
+        }
+    }
+
+private:
+    QMozContext* mContext;
+    int mIndex;
+    int mCount;
+};
+
+/*
+ * QMozContext against a running Gecko, driven by the Qt event pump so
+ * that runEmbedding() returns and test functions run on the Qt loop.
+ */
+class tst_Context : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void longTaskThresholdFromObserver();
+    void postWaitWhenFull();
+    void prefsReadBack_data();
+    void prefsReadBack();
+
+private:
+    QMozContext* mContext;
+};
+
+// Starts Gecko the way a fast launching embedder does: the library
+// loads on a background thread while calls needing it are queued
+void tst_Context::initTestCase()
+{
+    QMozContext::setLoadAsynchronously(true);
+    QMozContext::setPumpType(QMozContext::QtEventPump);
+    mContext = QMozContext::GetInstance();
+    // Bound from the event loop once the loader thread is done
+    QVERIFY(!mContext->isAppBound());
+
+    QString componentPath(DEFAULT_COMPONENTS_PATH);
+    mContext->addComponentManifest(componentPath + QString("/components") + QString("/EmbedLiteBinComponents.manifest"));
+    mContext->addComponentManifest(componentPath + QString("/chrome") + QString("/EmbedLiteJSScripts.manifest"));
+    mContext->addComponentManifest(componentPath + QString("/chrome") + QString("/EmbedLiteOverrides.manifest"));
+    mContext->addComponentManifest(componentPath + QString("/components") + QString("/EmbedLiteJSComponents.manifest"));
+
+    // Queued until Initialized(), read back by prefsReadBack()
+    mContext->setPref("embedlite.test.float.early", QVariant(1.5f));
+    mContext->setPref("embedlite.test.int.early", QVariant(42));
+    mContext->setPref("embedlite.test.wholedouble.early", QVariant(7.0));
+
+    // Stopping before the app is bound only drops the pending start
+    mContext->runEmbedding();
+    mContext->stopEmbedding();
+
+    QSignalSpy appBound(mContext, SIGNAL(appBound()));
+    QSignalSpy initialized(mContext, SIGNAL(onInitialized()));
+    bool startedBeforeBound = false;
+    QMetaObject::Connection check = connect(mContext, &QMozContext::appBound, [&]() {
+        Q_FOREACH (const QVariant& phase, mContext->startupTimeline()) {
+            if (phase.toMap().value("phase") == QStringLiteral("runEmbedding")) {
+                startedBeforeBound = true;
+            }
+        }
+    });
+    mContext->runEmbedding();
+    QVERIFY(!mContext->isAppBound());
+
+    QVERIFY(appBound.wait(30000));
+    disconnect(check);
+    QVERIFY(mContext->isAppBound());
+    QVERIFY(!startedBeforeBound);
+    QVERIFY(initialized.count() || initialized.wait(30000));
+    QVERIFY(mContext->initialized());
+}
+
+void tst_Context::cleanupTestCase()
+{
+    mContext->stopEmbedding();
+}
+
+// Turning the watchdog off from a task it is timing, here the OnObserve
+// phase, keeps it alive until that task has returned
+void tst_Context::longTaskThresholdFromObserver()
+{
+    mContext->setLongTaskThreshold(1000);
+    QPointer<GeckoWatchdog> watchdog = mContext->longTaskWatchdog();
+    QVERIFY(watchdog);
+
+    bool handled = false;
+    int id = mContext->registerObserverPayloadHandler("test-watchdog-message", [&](const QString&, QMozJsonPayload*) {
+        mContext->setLongTaskThreshold(0);
+        handled = true;
+    });
+    QVariantMap data;
+    data.insert("msg", QStringLiteral("stop"));
+    mContext->sendObserve("test-watchdog-message", QVariant(data));
+    QTRY_VERIFY(handled);
+    QVERIFY(!mContext->longTaskWatchdog());
+    QTRY_VERIFY(watchdog.isNull());
+    mContext->unregisterObserverHandler(id);
+}
+
+// Posters block while the queue is full and continue as the context
+// thread drains it, nothing is dropped or reordered per thread
+void tst_Context::postWaitWhenFull()
+{
+    const int posters = 4;
+    const int count = 50;
+    mContext->setPostQueueCapacity(2);
+    mContext->setPostQueueOverflowPolicy(QMozContext::WaitWhenFull);
+    mContext->resetPostQueueStatistics();
+
+    QVector<int> lastSequence(posters, -1);
+    int received = 0;
+    bool ordered = true;
+    int id = mContext->registerObserverHandler("test-postqueue-message", [&](const QString&, const QVariant& aData) {
+        const QVariantMap data = aData.toMap();
+        const int poster = data.value("poster").toInt();
+        const int sequence = data.value("sequence").toInt();
+        if (lastSequence.at(poster) + 1 != sequence) {
+            ordered = false;
+        }
+        lastSequence[poster] = sequence;
+        received++;
+    });
+
+    QList<Poster*> threads;
+    for (int i = 0; i < posters; ++i) {
+        threads.append(new Poster(mContext, i, count));
+        threads.last()->start();
+    }
+    // Posters only get room while this thread runs its event loop
+    Q_FOREACH (Poster* thread, threads) {
+        QTRY_VERIFY_WITH_TIMEOUT(thread->isFinished(), 30000);
+        QCOMPARE(thread->rejected, 0);
+        delete thread;
+    }
+    QTRY_COMPARE_WITH_TIMEOUT(received, posters * count, 30000);
+    QVERIFY(ordered);
+
+    QTRY_COMPARE(mContext->postQueueDepth(), 0);
+    const QVariantMap statistics = mContext->postQueueStatistics();
+    QCOMPARE(statistics.value("dropped").toInt(), 0);
+    QCOMPARE(statistics.value("applied").toInt(), 2 * posters * count);
+    QVERIFY(statistics.value("maxDepth").toInt() <= 2);
+
+    mContext->unregisterObserverHandler(id);
+    mContext->setPostQueueOverflowPolicy(QMozContext::RejectWhenFull);
+    mContext->setPostQueueCapacity(4096);
+}
+
+void tst_Context::prefsReadBack_data()
+{
+    QTest::addColumn<QString>("phase");
+    QTest::newRow("before-initialized") << QStringLiteral("early");
+    QTest::newRow("after-initialized") << QStringLiteral("late");
+}
+
+// Gecko has no float prefs: fractions are stored as char prefs in
+// Preferences::GetFloat() format, whole numbers as int prefs
+void tst_Context::prefsReadBack()
+{
+    QFETCH(QString, phase);
+    const QString floatPref = QString("embedlite.test.float.%1").arg(phase);
+    const QString intPref = QString("embedlite.test.int.%1").arg(phase);
+    const QString wholePref = QString("embedlite.test.wholedouble.%1").arg(phase);
+    if (phase == QStringLiteral("late")) {
+        mContext->setPref(floatPref, QVariant(1.5f));
+        mContext->setPref(intPref, QVariant(42));
+        mContext->setPref(wholePref, QVariant(7.0));
+    }
+
+    // EmbedLite's pref service answers getPrefList with [{name, type, value}]
+    QVariantMap prefs;
+    int id = mContext->registerObserverHandler("embed:prefs", [&](const QString&, const QVariant& aData) {
+        Q_FOREACH (const QVariant& pref, aData.toList()) {
+            const QVariantMap entry = pref.toMap();
+            prefs.insert(entry.value("name").toString(), entry);
+        }
+    });
+    QVariantMap request;
+    request.insert("msg", QStringLiteral("getPrefList"));
+    request.insert("prefs", QStringList() << floatPref << intPref << wholePref);
+    mContext->sendObserve("embedui:prefs", QVariant(request));
+    QTRY_COMPARE_WITH_TIMEOUT(prefs.size(), 3, 10000);
+    mContext->unregisterObserverHandler(id);
+
+    QCOMPARE(prefs.value(floatPref).toMap().value("type").toString(), QStringLiteral("string"));
+    QCOMPARE(prefs.value(floatPref).toMap().value("value").toString(), QStringLiteral("1.5"));
+    QCOMPARE(prefs.value(intPref).toMap().value("type").toString(), QStringLiteral("int"));
+    QCOMPARE(prefs.value(intPref).toMap().value("value").toInt(), 42);
+    QCOMPARE(prefs.value(wholePref).toMap().value("type").toString(), QStringLiteral("int"));
+    QCOMPARE(prefs.value(wholePref).toMap().value("value").toInt(), 7);
+}
+
+QTEST_MAIN(tst_Context)
+
+#include "tst_context.moc"
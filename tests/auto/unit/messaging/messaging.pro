@@ -0,0 +1,20 @@
+TEMPLATE = app
+TARGET = tst_messaging
+CONFIG += warn_on testcase
+QT += testlib
+
+# QMozReturnValue and QMozMessageSerializer only depend on QtCore
+QTMOZEMBED_SOURCE_PATH = $$PWD/../../../../src
+INCLUDEPATH += $$QTMOZEMBED_SOURCE_PATH
+
+SOURCES += tst_messaging.cpp \
+           $$QTMOZEMBED_SOURCE_PATH/qmozmessageserializer.cpp
+HEADERS += $$QTMOZEMBED_SOURCE_PATH/qmozmessageserializer.h \
+           $$QTMOZEMBED_SOURCE_PATH/qmozview_defined_wrapper.h
+
+RELATIVE_PATH=../../../..
+VDEPTH_PATH=tests/auto/unit/messaging
+include($$RELATIVE_PATH/relative-objdir.pri)
+
+target.path = /opt/tests/qtmozembed/unit
+INSTALLS += target
@@ -0,0 +1,166 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <QtTest/QtTest>
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QJsonDocument>
+
+#include "qmozmessageserializer.h"
+#include "qmozview_defined_wrapper.h"
+
+/*
+ * Answers a deferred sync message reply from a worker thread, the way a
+ * handler handing the lookup off to another thread does.
+ */
+class DeferredAnswer : public QThread
+{
+public:
+    DeferredAnswer(QMozReturnValue* aReply, int aDelay)
+        : mReply(aReply)
+        , mDelay(aDelay)
+    {
+    }
+
+    virtual void run()
+    {
+        msleep(mDelay);
+        mReply->setString(QStringLiteral("answer"));
+    }
+
+private:
+    QMozReturnValue* mReply;
+    int mDelay;
+};
+
+class tst_Messaging : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void deferredReplyAnswered();
+    void deferredReplyTimeout();
+    void deferredReplyAnsweredOnce();
+
+    void scalarRoundTrip_data();
+    void scalarRoundTrip();
+};
+
+// Answer from another thread wakes the blocked wait before the deadline,
+// releasing the answered reply frees it
+void tst_Messaging::deferredReplyAnswered()
+{
+    QPointer<QMozReturnValue> reply = new QMozReturnValue();
+    reply->defer();
+    DeferredAnswer answer(reply, 20);
+    QElapsedTimer elapsed;
+    elapsed.start();
+    answer.start();
+    QVERIFY(reply->waitForAnswer(5000));
+    QVERIFY(elapsed.elapsed() < 5000);
+    answer.wait();
+    QVERIFY(reply->answered());
+    QCOMPARE(reply->replyType(), QMozReturnValue::StringReply);
+    QCOMPARE(reply->text(), QStringLiteral("answer"));
+
+    QMozMessageSerializer serializer;
+    QCOMPARE(serializer.serializeStringUtf8(reply->text()), QByteArray("\"answer\""));
+
+    reply->release();
+    QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+    QVERIFY(reply.isNull());
+}
+
+// No answer within the deadline: releasing expires the reply, the late
+// answer is dropped and frees it
+void tst_Messaging::deferredReplyTimeout()
+{
+    QPointer<QMozReturnValue> reply = new QMozReturnValue();
+    reply->defer();
+    QElapsedTimer elapsed;
+    elapsed.start();
+    QVERIFY(!reply->waitForAnswer(50));
+    QVERIFY(elapsed.elapsed() >= 50);
+    QVERIFY(!reply->answered());
+
+    reply->release();
+    QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+    QVERIFY(!reply.isNull());
+
+    QSignalSpy replied(reply.data(), SIGNAL(replied()));
+    DeferredAnswer answer(reply, 0);
+    answer.start();
+    answer.wait();
+    QCOMPARE(replied.count(), 0);
+    QVERIFY(!reply->answered());
+    QCOMPARE(reply->replyType(), QMozReturnValue::VariantReply);
+    QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+    QVERIFY(reply.isNull());
+
+    // A zero deadline does not wait at all
+    QMozReturnValue immediate;
+    immediate.defer();
+    QVERIFY(!immediate.waitForAnswer(0));
+}
+
+// Only the first answer counts, plain replies can be overwritten
+void tst_Messaging::deferredReplyAnsweredOnce()
+{
+    QMozReturnValue reply;
+    reply.defer();
+    QSignalSpy replied(&reply, SIGNAL(replied()));
+    reply.setNumber(1);
+    reply.setBool(true);
+    QCOMPARE(replied.count(), 1);
+    QCOMPARE(reply.replyType(), QMozReturnValue::NumberReply);
+    QCOMPARE(reply.number(), 1.0);
+
+    QMozReturnValue plain;
+    plain.setNumber(1);
+    plain.setString(QStringLiteral("last"));
+    QCOMPARE(plain.replyType(), QMozReturnValue::StringReply);
+    QVERIFY(!plain.answered());
+}
+
+void tst_Messaging::scalarRoundTrip_data()
+{
+    QTest::addColumn<QVariant>("value");
+    QTest::addColumn<QString>("json");
+
+    QTest::newRow("string") << QVariant(QStringLiteral("a \"b\"")) << QStringLiteral("\"a \\\"b\\\"\"");
+    QTest::newRow("int") << QVariant(42) << QStringLiteral("42");
+    QTest::newRow("double") << QVariant(0.5) << QStringLiteral("0.5");
+    QTest::newRow("bool") << QVariant(true) << QStringLiteral("true");
+    QTest::newRow("null") << QVariant() << QStringLiteral("null");
+}
+
+// Top level scalars come out as the same JSON value in both formats and
+// parse back to the value they were written from
+void tst_Messaging::scalarRoundTrip()
+{
+    QFETCH(QVariant, value);
+    QFETCH(QString, json);
+
+    QMozMessageSerializer compact(QMozMessageSerializer::CompactJson);
+    QMozMessageSerializer indented(QMozMessageSerializer::IndentedJson);
+    QCOMPARE(compact.serialize(value), json);
+    QCOMPARE(indented.serialize(value), json);
+    QCOMPARE(compact.serializeUtf8(value), json.toUtf8());
+    QCOMPARE(indented.serializeUtf8(value), json.toUtf8());
+
+    // QJsonDocument only parses containers, wrap the value to read it back
+    const QString wrapped = QLatin1Char('[') + indented.serialize(value) + QLatin1Char(']');
+    const QVariantList parsed = QJsonDocument::fromJson(wrapped.toUtf8()).toVariant().toList();
+    QCOMPARE(parsed.size(), 1);
+    if (value.isValid()) {
+        QCOMPARE(parsed.at(0).toString(), value.toString());
+    } else {
+        QVERIFY(parsed.at(0).isNull());
+    }
+}
+
+QTEST_GUILESS_MAIN(tst_Messaging)
+
+#include "tst_messaging.moc"
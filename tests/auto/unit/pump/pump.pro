@@ -0,0 +1,22 @@
+TEMPLATE = app
+TARGET = tst_pump
+CONFIG += warn_on testcase
+QT += testlib quick
+
+# MessagePumpQt is built from the library sources against the stub
+# EmbedLite headers of the pump benchmark, no Gecko SDK is needed.
+QTMOZEMBED_SOURCE_PATH = $$PWD/../../../../src
+INCLUDEPATH += $$PWD/../../../benchmarks/pump/stub $$QTMOZEMBED_SOURCE_PATH
+
+SOURCES += tst_pump.cpp \
+           $$QTMOZEMBED_SOURCE_PATH/qmessagepump.cpp \
+           $$QTMOZEMBED_SOURCE_PATH/geckowatchdog.cpp
+HEADERS += $$QTMOZEMBED_SOURCE_PATH/qmessagepump.h \
+           $$QTMOZEMBED_SOURCE_PATH/geckowatchdog.h
+
+RELATIVE_PATH=../../../..
+VDEPTH_PATH=tests/auto/unit/pump
+include($$RELATIVE_PATH/relative-objdir.pri)
+
+target.path = /opt/tests/qtmozembed/unit
+INSTALLS += target
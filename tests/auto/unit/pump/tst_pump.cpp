@@ -0,0 +1,136 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <QtTest/QtTest>
+#include <QElapsedTimer>
+#include <QQuickWindow>
+
+#include "qmessagepump.h"
+#include "mozilla/embedlite/EmbedLiteApp.h"
+
+using namespace mozilla::embedlite;
+
+/*
+ * Gecko loop that always has more idle work, like a long GC, and spends
+ * sliceCost microseconds in every DoIdleWork() call.
+ */
+class IdlePump : public EmbedLiteMessagePump
+{
+public:
+    explicit IdlePump(EmbedLiteMessagePumpListener* aListener)
+        : EmbedLiteMessagePump(aListener)
+        , sliceCost(1000)
+        , idleSlices(0)
+    {
+    }
+
+    virtual bool DoIdleWork(void* aDelegate)
+    {
+        idleSlices++;
+        QElapsedTimer spin;
+        spin.start();
+        while (spin.nsecsElapsed() < sliceCost * 1000LL) {
+        }
+        return true;
+    }
+
+    int sliceCost;
+    int idleSlices;
+};
+
+static IdlePump* sLastPump = 0;
+
+static EmbedLiteMessagePump*
+createIdlePump(EmbedLiteMessagePumpListener* aListener)
+{
+    sLastPump = new IdlePump(aListener);
+    return sLastPump;
+}
+
+// Runs the Qt event loop for aMsec, well within one frame interval
+static void
+spin(int aMsec)
+{
+    QElapsedTimer elapsed;
+    elapsed.start();
+    while (!elapsed.hasExpired(aMsec)) {
+        QCoreApplication::processEvents();
+    }
+}
+
+class tst_Pump : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void idleWorkUngatedByDefault();
+    void idleWorkBudgetedPerFrame();
+
+private:
+    EmbedLiteApp* mApp;
+    MessagePumpQt* mPump;
+    QQuickWindow* mWindow;
+    int mDelegate;
+};
+
+void tst_Pump::init()
+{
+    mApp = new EmbedLiteApp(createIdlePump);
+    mPump = new MessagePumpQt(mApp);
+    mWindow = new QQuickWindow();
+}
+
+void tst_Pump::cleanup()
+{
+    mPump->Quit();
+    delete mPump;
+    delete mWindow;
+    delete mApp;
+    sLastPump = 0;
+}
+
+// A window alone does not gate idle work, a budget has to be set too
+void tst_Pump::idleWorkUngatedByDefault()
+{
+    QCOMPARE(mPump->idleBudgetPerFrame(), 0);
+    mPump->setIdleFrameWindow(mWindow);
+    mPump->Run(&mDelegate);
+    mPump->ScheduleWork();
+    spin(10);
+    QVERIFY(sLastPump->idleSlices > 0);
+    QCOMPARE(mPump->deferredIdleSlices(), 0);
+}
+
+// Idle work waits for a swapped frame and stops once the per frame
+// budget is spent, the next frame opens a new budget
+void tst_Pump::idleWorkBudgetedPerFrame()
+{
+    const int budget = 3;
+    mPump->setIdleBudgetPerFrame(budget);
+    mPump->setIdleFrameWindow(mWindow);
+    mPump->Run(&mDelegate);
+    mPump->ScheduleWork();
+    spin(10);
+    QCOMPARE(sLastPump->idleSlices, 0);
+    QCOMPARE(mPump->deferredIdleSlices(), 1);
+
+    for (int frame = 1; frame <= 3; ++frame) {
+        const int before = sLastPump->idleSlices;
+        Q_EMIT mWindow->frameSwapped();
+        spin(10);
+        const int slices = sLastPump->idleSlices - before;
+        // Slices start while less than the budget was spent this frame
+        QVERIFY2(slices >= 1 && slices <= budget,
+                 qPrintable(QStringLiteral("frame %1 ran %2 slices").arg(frame).arg(slices)));
+        QCOMPARE(mPump->deferredIdleSlices(), frame + 1);
+    }
+}
+
+QTEST_MAIN(tst_Pump)
+
+#include "tst_pump.moc"
@@ -0,0 +1,3 @@
+TEMPLATE = subdirs
+
+SUBDIRS = pump payload postqueue
@@ -0,0 +1,24 @@
+TEMPLATE = app
+TARGET = tst_payloadbenchmark
+CONFIG += warn_on testcase
+QT += testlib
+
+# QMozJsonPayload, QMozMessageSerializer and QMozPayloadDecoder only
+# depend on QtCore
+QTMOZEMBED_SOURCE_PATH = $$PWD/../../../src
+INCLUDEPATH += $$QTMOZEMBED_SOURCE_PATH
+
+SOURCES += tst_payloadbenchmark.cpp \
+           $$QTMOZEMBED_SOURCE_PATH/qmozjsonpayload.cpp \
+           $$QTMOZEMBED_SOURCE_PATH/qmozmessageserializer.cpp \
+           $$QTMOZEMBED_SOURCE_PATH/qmozpayloaddecoder.cpp
+HEADERS += $$QTMOZEMBED_SOURCE_PATH/qmozjsonpayload.h \
+           $$QTMOZEMBED_SOURCE_PATH/qmozmessageserializer.h \
+           $$QTMOZEMBED_SOURCE_PATH/qmozpayloaddecoder.h
+
+RELATIVE_PATH=../../..
+VDEPTH_PATH=tests/benchmarks/payload
+include($$RELATIVE_PATH/relative-objdir.pri)
+
+target.path = /opt/tests/qtmozembed/benchmarks
+INSTALLS += target
@@ -0,0 +1,416 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <QtTest/QtTest>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+
+#include "qmozjsonpayload.h"
+#include "qmozmessageserializer.h"
+#include "qmozpayloaddecoder.h"
+
+/*
+ * Message shaped like the ones frame scripts send: a few scalar fields
+ * followed by an array of records, padded up to roughly aSize bytes.
+ */
+static QString
+makeMessage(int aSize)
+{
+    QString message = QStringLiteral("{\"msg\":\"embed:test\",\"id\":42,\"ok\":true,\"items\":[");
+    for (int i = 0; message.size() < aSize; ++i) {
+        if (i) {
+            message += QLatin1Char(',');
+        }
+        message += QStringLiteral("{\"index\":%1,\"title\":\"Item %1\",\"url\":\"http://example.com/%1\"}").arg(i);
+    }
+    message += QStringLiteral("]}");
+    return message;
+}
+
+/*
+ * Outbound counterpart of makeMessage(), as built by form autofill and
+ * session store code in QML.
+ */
+static QVariant
+makeVariant(int aSize)
+{
+    QVariantMap data;
+    data.insert("msg", QStringLiteral("embed:test"));
+    data.insert("id", 42);
+    data.insert("ok", true);
+    QVariantList items;
+    int size = 0;
+    for (int i = 0; size < aSize; ++i) {
+        QVariantMap item;
+        item.insert("index", i);
+        item.insert("title", QStringLiteral("Item \"%1\"\n").arg(i));
+        item.insert("url", QStringLiteral("http://example.com/%1").arg(i));
+        item.insert("score", i / 3.0);
+        items.append(item);
+        size += 80;
+    }
+    data.insert("items", items);
+    return data;
+}
+
+class tst_PayloadBenchmark : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void typedGetters();
+    void decode_data();
+    void decode();
+
+    void compactRoundTrip();
+    void encode_data();
+    void encode();
+
+    void decoderOrdering();
+    void decoderCancel();
+    void offThreadLatency_data();
+    void offThreadLatency();
+
+    void batchFormat();
+    void batchSend_data();
+    void batchSend();
+};
+
+void tst_PayloadBenchmark::typedGetters()
+{
+    QMozJsonPayload payload(makeMessage(1024));
+    QVERIFY(!payload.parsed());
+    QVERIFY(payload.valid());
+    QCOMPARE(payload.string("msg"), QStringLiteral("embed:test"));
+    QCOMPARE(payload.number("id"), 42.0);
+    QCOMPARE(payload.boolean("ok"), true);
+    QCOMPARE(payload.number("missing", -1), -1.0);
+    QCOMPARE(payload.value("items").toList().first().toMap().value("index").toInt(), 0);
+    QCOMPARE(payload.toVariant(), QJsonDocument::fromJson(payload.raw().toUtf8()).toVariant());
+
+    QMozJsonPayload plain(QStringLiteral("plain text"));
+    QVERIFY(plain.valid());
+    QCOMPARE(plain.toVariant().toString(), QStringLiteral("plain text"));
+
+    QMozJsonPayload broken(QStringLiteral("{\"msg\":"));
+    QVERIFY(!broken.valid());
+    QVERIFY(!broken.toVariant().isValid());
+}
+
+void tst_PayloadBenchmark::decode_data()
+{
+    QTest::addColumn<int>("size");
+    QTest::addColumn<QString>("mode");
+    const int sizes[] = { 1024, 64 * 1024, 1024 * 1024 };
+    for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        QByteArray size = QByteArray::number(sizes[i] / 1024) + "KB";
+        QTest::newRow(size + "-eager") << sizes[i] << QString("eager");
+        QTest::newRow(size + "-lazy-field") << sizes[i] << QString("field");
+        QTest::newRow(size + "-lazy-ignored") << sizes[i] << QString("ignored");
+    }
+}
+
+// Cost of handing one message to a handler reading the "msg" field: the
+// old eager toVariant() path against QMozJsonPayload, and against a
+// handler that never touches the payload.
+void tst_PayloadBenchmark::decode()
+{
+    QFETCH(int, size);
+    QFETCH(QString, mode);
+    const QString message = makeMessage(size);
+
+    if (mode == "eager") {
+        QBENCHMARK {
+            QVariant data = QJsonDocument::fromJson(message.toUtf8()).toVariant();
+            QCOMPARE(data.toMap().value("msg").toString(), QStringLiteral("embed:test"));
+        }
+    } else if (mode == "field") {
+        QBENCHMARK {
+            QMozJsonPayload payload(message);
+            QCOMPARE(payload.string("msg"), QStringLiteral("embed:test"));
+        }
+    } else {
+        QBENCHMARK {
+            QMozJsonPayload payload(message);
+            Q_UNUSED(payload);
+        }
+    }
+}
+
+void tst_PayloadBenchmark::compactRoundTrip()
+{
+    QVariant data = makeVariant(1024);
+    QMozMessageSerializer serializer;
+    const QString& json = serializer.serialize(data);
+    QVERIFY(!json.contains(QLatin1Char('\n')));
+    QCOMPARE(QJsonDocument::fromJson(json.toUtf8()).toVariant(), QJsonDocument::fromVariant(data).toVariant());
+
+    // The buffer is kept across calls of similar size
+    int capacity = serializer.capacity();
+    serializer.serialize(data);
+    QCOMPARE(serializer.capacity(), capacity);
+
+    // Sync message replies
+    const QString text = QString::fromUtf8("caf\xc3\xa9 \xf0\x9f\x98\x80 \"quoted\"");
+    QCOMPARE(serializer.serializeUtf8(text), serializer.serialize(text).toUtf8());
+    QCOMPARE(serializer.serializeUtf8(1.5), QByteArray("1.5"));
+    QCOMPARE(serializer.serializeUtf8(QString("[1,2]"), true), QByteArray("[1,2]"));
+    // Typed replies match their QVariant counterparts
+    QCOMPARE(serializer.serializeStringUtf8(text), serializer.serialize(text).toUtf8());
+    QCOMPARE(serializer.serializeNumberUtf8(1.5), QByteArray("1.5"));
+    QCOMPARE(serializer.serializeBoolUtf8(false), QByteArray("false"));
+}
+
+void tst_PayloadBenchmark::encode_data()
+{
+    QTest::addColumn<int>("size");
+    QTest::addColumn<QString>("mode");
+    const int sizes[] = { 1024, 64 * 1024, 1024 * 1024 };
+    for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        QByteArray size = QByteArray::number(sizes[i] / 1024) + "KB";
+        QTest::newRow(size + "-indented") << sizes[i] << QString("indented");
+        QTest::newRow(size + "-qjson-compact") << sizes[i] << QString("qjson-compact");
+        QTest::newRow(size + "-serializer") << sizes[i] << QString("serializer");
+    }
+}
+
+// Cost of turning outbound data into the UTF-16 text handed to
+// SendAsyncMessage(): the previous indented toJson() plus UTF-8 to
+// UTF-16 conversion, compact toJson(), and QMozMessageSerializer.
+void tst_PayloadBenchmark::encode()
+{
+    QFETCH(int, size);
+    QFETCH(QString, mode);
+    const QVariant data = makeVariant(size);
+
+    if (mode == "indented") {
+        QBENCHMARK {
+            QString json = QString::fromUtf8(QJsonDocument::fromVariant(data).toJson());
+            QVERIFY(!json.isEmpty());
+        }
+    } else if (mode == "qjson-compact") {
+        QBENCHMARK {
+            QString json = QString::fromUtf8(QJsonDocument::fromVariant(data).toJson(QJsonDocument::Compact));
+            QVERIFY(!json.isEmpty());
+        }
+    } else {
+        QMozMessageSerializer serializer;
+        QBENCHMARK {
+            const QString& json = serializer.serialize(data);
+            QVERIFY(!json.isEmpty());
+        }
+    }
+}
+
+// Large and small messages of one channel come out in call order, other
+// channels are not held up by them.
+void tst_PayloadBenchmark::decoderOrdering()
+{
+    QMozPayloadDecoder decoder;
+    decoder.setThreshold(64 * 1024);
+    QStringList delivered;
+    QMozPayloadDecoder::Callback record = [&delivered](const QVariant& aData, bool aOk) {
+        QVERIFY(aOk);
+        delivered.append(aData.toMap().value("msg").toString());
+    };
+    const int owner = 0;
+
+    QMozJsonPayload small(QStringLiteral("{\"msg\":\"small\"}"));
+    decoder.decode(&owner, "ch", small, record);
+    QCOMPARE(delivered, QStringList() << "small");
+    delivered.clear();
+
+    QMozJsonPayload large1(makeMessage(512 * 1024).replace("embed:test", "large1"));
+    QMozJsonPayload small1(QStringLiteral("{\"msg\":\"small1\"}"));
+    QMozJsonPayload large2(makeMessage(512 * 1024).replace("embed:test", "large2"));
+    QMozJsonPayload small2(QStringLiteral("{\"msg\":\"small2\"}"));
+    QMozJsonPayload other(QStringLiteral("{\"msg\":\"other\"}"));
+    decoder.decode(&owner, "ch", large1, record);
+    decoder.decode(&owner, "ch", small1, record);
+    decoder.decode(&owner, "ch", large2, record);
+    decoder.decode(&owner, "ch", small2, record);
+    QCOMPARE(decoder.pending(), 4);
+    QCOMPARE(decoder.offThreadDecodes(), 2);
+
+    decoder.decode(&owner, "other", other, record);
+    QCOMPARE(delivered, QStringList() << "other");
+
+    QTRY_COMPARE(decoder.pending(), 0);
+    QCOMPARE(delivered, QStringList() << "other" << "large1" << "small1" << "large2" << "small2");
+
+    // Broken text is reported, not dropped
+    QMozJsonPayload broken(makeMessage(512 * 1024).left(100 * 1024));
+    bool done = false;
+    decoder.decode(&owner, "ch", broken, [&done](const QVariant& aData, bool aOk) {
+        QVERIFY(!aOk);
+        QVERIFY(!aData.isValid());
+        done = true;
+    });
+    QTRY_VERIFY(done);
+}
+
+void tst_PayloadBenchmark::decoderCancel()
+{
+    QMozPayloadDecoder decoder;
+    decoder.setThreshold(64 * 1024);
+    int delivered = 0;
+    QMozPayloadDecoder::Callback count = [&delivered](const QVariant&, bool) {
+        delivered++;
+    };
+    const int gone = 0;
+    const int alive = 0;
+
+    QMozJsonPayload large(makeMessage(512 * 1024));
+    QMozJsonPayload small(QStringLiteral("{\"msg\":\"small\"}"));
+    decoder.decode(&gone, "ch", large, count);
+    decoder.decode(&gone, "ch", small, count);
+    decoder.decode(&alive, "ch", large, count);
+    decoder.cancel(&gone);
+    QCOMPARE(decoder.pending(), 1);
+
+    QTRY_COMPARE(decoder.pending(), 0);
+    QCOMPARE(delivered, 1);
+}
+
+void tst_PayloadBenchmark::offThreadLatency_data()
+{
+    QTest::addColumn<int>("size");
+    QTest::addColumn<bool>("offThread");
+    const int sizes[] = { 256 * 1024, 1024 * 1024, 4 * 1024 * 1024 };
+    for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        QByteArray size = QByteArray::number(sizes[i] / 1024) + "KB";
+        QTest::newRow(size + "-gui-thread") << sizes[i] << false;
+        QTest::newRow(size + "-off-thread") << sizes[i] << true;
+    }
+}
+
+// Longest stretch the event loop is blocked while a message is decoded,
+// which is what a 16 ms frame sees. End to end latency is printed too.
+void tst_PayloadBenchmark::offThreadLatency()
+{
+    QFETCH(int, size);
+    QFETCH(bool, offThread);
+    const int samples = 10;
+    const QString message = makeMessage(size);
+    const int owner = 0;
+
+    QMozPayloadDecoder decoder;
+    decoder.setThreshold(offThread ? 64 * 1024 : 0);
+
+    qint64 worstStall = 0;
+    qint64 totalLatency = 0;
+    for (int i = 0; i < samples; ++i) {
+        QMozJsonPayload payload(message);
+        bool done = false;
+        QElapsedTimer latency;
+        latency.start();
+        QElapsedTimer stall;
+        stall.start();
+        decoder.decode(&owner, "ch", payload, [&done](const QVariant& aData, bool) {
+            QVERIFY(aData.isValid());
+            done = true;
+        });
+        worstStall = qMax(worstStall, stall.nsecsElapsed());
+        while (!done) {
+            stall.start();
+            QCoreApplication::processEvents();
+            worstStall = qMax(worstStall, stall.nsecsElapsed());
+        }
+        totalLatency += latency.nsecsElapsed();
+    }
+    qDebug("mean end to end latency %.2f ms", totalLatency / samples / 1000000.0);
+    QTest::setBenchmarkResult(worstStall / 1000000.0, QTest::WalltimeMilliseconds);
+}
+
+void tst_PayloadBenchmark::batchFormat()
+{
+    QVariantList messages;
+    QVariantMap first;
+    first.insert("name", QStringLiteral("embed:setting"));
+    first.insert("data", makeVariant(200));
+    messages.append(first);
+    QVariantMap unnamed;
+    unnamed.insert("data", 1);
+    messages.append(unnamed);
+    QVariantMap second;
+    second.insert("name", QStringLiteral("embed:formfield"));
+    messages.append(second);
+
+    QVariantList expected;
+    expected.append(QVariant(QVariantList() << first.value("name") << first.value("data")));
+    expected.append(QVariant(QVariantList() << second.value("name") << QVariant()));
+
+    QMozMessageSerializer serializer;
+    const QString& json = serializer.serializeBatch(messages);
+    QCOMPARE(QJsonDocument::fromJson(json.toUtf8()).toVariant(), QJsonDocument::fromVariant(expected).toVariant());
+
+    QMozMessageSerializer indented(QMozMessageSerializer::IndentedJson);
+    QCOMPARE(QJsonDocument::fromJson(indented.serializeBatch(messages).toUtf8()).toVariant(),
+             QJsonDocument::fromVariant(expected).toVariant());
+    QCOMPARE(serializer.serializeBatch(QVariantList()), QStringLiteral("[]"));
+}
+
+void tst_PayloadBenchmark::batchSend_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::addColumn<bool>("batched");
+    const int counts[] = { 10, 50, 200 };
+    for (unsigned i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+        QByteArray count = QByteArray::number(counts[i]) + "-messages";
+        QTest::newRow(count + "-single") << counts[i] << false;
+        QTest::newRow(count + "-batched") << counts[i] << true;
+    }
+}
+
+/*
+ * Messages per second for a burst of small settings updates, sent one by
+ * one as sendAsyncMessage() does and packed as sendAsyncMessages() does.
+ * A crossing is modelled by what EmbedLiteView::SendAsyncMessage() does
+ * on this side: copying name and data into a message queued for the
+ * Gecko thread. Gecko's own per-message dispatch cost comes on top.
+ */
+void tst_PayloadBenchmark::batchSend()
+{
+    QFETCH(int, count);
+    QFETCH(bool, batched);
+    const int bursts = 200;
+
+    QVariantList messages;
+    for (int i = 0; i < count; ++i) {
+        QVariantMap data;
+        data.insert("key", QStringLiteral("browser.setting.%1").arg(i));
+        data.insert("value", i % 2 == 0);
+        QVariantMap message;
+        message.insert("name", QStringLiteral("embed:setting"));
+        message.insert("data", data);
+        messages.append(message);
+    }
+
+    QMozMessageSerializer serializer;
+    QList<QPair<QString, QString> > crossings;
+    QElapsedTimer elapsed;
+    elapsed.start();
+    for (int burst = 0; burst < bursts; ++burst) {
+        crossings.clear();
+        if (batched) {
+            const QString& data = serializer.serializeBatch(messages);
+            crossings.append(qMakePair(QStringLiteral("embed:batch"), QString(data.constData(), data.size())));
+        } else {
+            Q_FOREACH (const QVariant& message, messages) {
+                const QVariantMap entry = message.toMap();
+                const QString name = entry.value("name").toString();
+                const QString& data = serializer.serialize(entry.value("data"));
+                crossings.append(qMakePair(QString(name.constData(), name.size()), QString(data.constData(), data.size())));
+            }
+        }
+    }
+    QCOMPARE(crossings.size(), batched ? 1 : count);
+    qint64 nsecs = qMax(elapsed.nsecsElapsed(), Q_INT64_C(1));
+    QTest::setBenchmarkResult(qreal(bursts) * count * 1000000000.0 / nsecs, QTest::Events);
+}
+
+QTEST_GUILESS_MAIN(tst_PayloadBenchmark)
+
+#include "tst_payloadbenchmark.moc"
@@ -0,0 +1,19 @@
+TEMPLATE = app
+TARGET = tst_postqueuebenchmark
+CONFIG += warn_on testcase
+QT += testlib
+
+# QMozPostQueue only depends on QtCore
+QTMOZEMBED_SOURCE_PATH = $$PWD/../../../src
+INCLUDEPATH += $$QTMOZEMBED_SOURCE_PATH
+
+SOURCES += tst_postqueuebenchmark.cpp \
+           $$QTMOZEMBED_SOURCE_PATH/qmozpostqueue.cpp
+HEADERS += $$QTMOZEMBED_SOURCE_PATH/qmozpostqueue.h
+
+RELATIVE_PATH=../../..
+VDEPTH_PATH=tests/benchmarks/postqueue
+include($$RELATIVE_PATH/relative-objdir.pri)
+
+target.path = /opt/tests/qtmozembed/benchmarks
+INSTALLS += target
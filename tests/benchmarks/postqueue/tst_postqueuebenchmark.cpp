@@ -0,0 +1,204 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <QtTest/QtTest>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include "qmozpostqueue.h"
+
+/*
+ * Stands in for QMozContext: drains the queue the way drainPostQueue()
+ * does, or receives the items one queued invokeMethod() at a time.
+ */
+class Consumer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit Consumer(QMozPostQueue* aQueue) : queue(aQueue), received(0), ordered(true) {}
+
+    void post(QMozPostItem* aItem)
+    {
+        bool pushed = queue->tryPush(aItem);
+        while (!pushed) {
+            QMutexLocker locker(&roomMutex);
+            pushed = queue->tryPush(aItem);
+            if (!pushed) {
+                room.wait(&roomMutex);
+            }
+        }
+        if (queue->scheduleDrain()) {
+            QMetaObject::invokeMethod(this, "drain", Qt::QueuedConnection);
+        }
+    }
+
+    QMozPostQueue* queue;
+    int received;
+    // Last sequence number seen per producer, they must only go up
+    QVector<int> lastSequence;
+    bool ordered;
+    QMutex roomMutex;
+    QWaitCondition room;
+
+public Q_SLOTS:
+    void drain()
+    {
+        queue->drainStarted();
+        while (QMozPostItem* item = queue->pop()) {
+            consume(item->name.toInt(), item->viewId);
+            delete item;
+        }
+        QMutexLocker locker(&roomMutex);
+        room.wakeAll();
+    }
+
+    void receive(int aProducer, int aSequence, const QString& aData)
+    {
+        Q_UNUSED(aData);
+        consume(aProducer, aSequence);
+    }
+
+private:
+    void consume(int aProducer, int aSequence)
+    {
+        if (lastSequence.at(aProducer) >= aSequence) {
+            ordered = false;
+        }
+        lastSequence[aProducer] = aSequence;
+        received++;
+    }
+};
+
+class Producer : public QThread
+{
+public:
+    Producer(Consumer* aConsumer, int aIndex, int aCount, bool aInvoke)
+        : mConsumer(aConsumer)
+        , mIndex(aIndex)
+        , mCount(aCount)
+        , mInvoke(aInvoke)
+    {
+    }
+
+protected:
+    virtual void run()
+    {
+        const QString data = QStringLiteral("{\"key\":\"browser.setting\",\"value\":true}");
+        for (int i = 0; i < mCount; ++i) {
+            if (mInvoke) {
+                QMetaObject::invokeMethod(mConsumer, "receive", Qt::QueuedConnection,
+                                          Q_ARG(int, mIndex), Q_ARG(int, i), Q_ARG(QString, data));
+            } else {
+                QMozPostItem* item = new QMozPostItem(QMozPostItem::Observe, QString::number(mIndex));
+                item->viewId = i;
+                item->data = data;
+                mConsumer->post(item);
+            }
+        }
+    }
+
+private:
+    Consumer* mConsumer;
+    int mIndex;
+    int mCount;
+    bool mInvoke;
+};
+
+class tst_PostQueueBenchmark : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void capacity();
+    void throughput_data();
+    void throughput();
+};
+
+void tst_PostQueueBenchmark::capacity()
+{
+    QMozPostQueue queue(2);
+    QMozPostItem* first = new QMozPostItem(QMozPostItem::Observe, "first");
+    QMozPostItem* second = new QMozPostItem(QMozPostItem::Pref, "second");
+    QMozPostItem third(QMozPostItem::AsyncMessage, "third");
+    QVERIFY(queue.tryPush(first));
+    QVERIFY(queue.tryPush(second));
+    QVERIFY(!queue.tryPush(&third));
+    QCOMPARE(queue.depth(), 2);
+    QCOMPARE(queue.maxDepth(), 2);
+
+    QVERIFY(queue.scheduleDrain());
+    QVERIFY(!queue.scheduleDrain());
+    queue.drainStarted();
+
+    QMozPostItem* item = queue.pop();
+    QCOMPARE(item, first);
+    delete item;
+    QCOMPARE(queue.depth(), 1);
+    // Last item is handed out behind the stub
+    item = queue.pop();
+    QCOMPARE(item, second);
+    delete item;
+    QVERIFY(!queue.pop());
+    QCOMPARE(queue.depth(), 0);
+
+    // Left over items are freed with the queue
+    QVERIFY(queue.tryPush(new QMozPostItem(QMozPostItem::Observe, "left")));
+}
+
+void tst_PostQueueBenchmark::throughput_data()
+{
+    QTest::addColumn<int>("producers");
+    QTest::addColumn<bool>("invoke");
+    const int producers[] = { 1, 4 };
+    for (unsigned i = 0; i < sizeof(producers) / sizeof(producers[0]); ++i) {
+        QByteArray count = QByteArray::number(producers[i]) + "-producers";
+        QTest::newRow(count + "-invokemethod") << producers[i] << true;
+        QTest::newRow(count + "-postqueue") << producers[i] << false;
+    }
+}
+
+// Items per second from worker threads to the consumer thread, one queued
+// invokeMethod() per item against QMozPostQueue with one wakeup per
+// drain. Checks nothing is lost or reordered per producer.
+void tst_PostQueueBenchmark::throughput()
+{
+    QFETCH(int, producers);
+    QFETCH(bool, invoke);
+    const int count = 100000;
+
+    QMozPostQueue queue(1024);
+    Consumer consumer(&queue);
+    consumer.lastSequence.fill(-1, producers);
+
+    QList<Producer*> threads;
+    for (int i = 0; i < producers; ++i) {
+        threads.append(new Producer(&consumer, i, count, invoke));
+    }
+    QElapsedTimer elapsed;
+    elapsed.start();
+    Q_FOREACH (Producer* thread, threads) {
+        thread->start();
+    }
+    while (consumer.received < producers * count) {
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+    }
+    qint64 nsecs = qMax(elapsed.nsecsElapsed(), Q_INT64_C(1));
+    Q_FOREACH (Producer* thread, threads) {
+        thread->wait();
+        delete thread;
+    }
+
+    QVERIFY(consumer.ordered);
+    QCOMPARE(queue.depth(), 0);
+    qDebug("max queue depth %i", queue.maxDepth());
+    QTest::setBenchmarkResult(qreal(producers) * count * 1000000000.0 / nsecs, QTest::Events);
+}
+
+QTEST_GUILESS_MAIN(tst_PostQueueBenchmark)
+
+#include "tst_postqueuebenchmark.moc"
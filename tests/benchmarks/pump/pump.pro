@@ -0,0 +1,22 @@
+TEMPLATE = app
+TARGET = tst_pumpbenchmark
+CONFIG += warn_on testcase
+QT += testlib quick
+
+# MessagePumpQt is built from the library sources against the stub
+# EmbedLite headers below, no Gecko SDK is needed.
+QTMOZEMBED_SOURCE_PATH = $$PWD/../../../src
+INCLUDEPATH += $$PWD/stub $$QTMOZEMBED_SOURCE_PATH
+
+SOURCES += tst_pumpbenchmark.cpp \
+           $$QTMOZEMBED_SOURCE_PATH/qmessagepump.cpp \
+           $$QTMOZEMBED_SOURCE_PATH/geckowatchdog.cpp
+HEADERS += $$QTMOZEMBED_SOURCE_PATH/qmessagepump.h \
+           $$QTMOZEMBED_SOURCE_PATH/geckowatchdog.h
+
+RELATIVE_PATH=../../..
+VDEPTH_PATH=tests/benchmarks/pump
+include($$RELATIVE_PATH/relative-objdir.pri)
+
+target.path = /opt/tests/qtmozembed/benchmarks
+INSTALLS += target
@@ -0,0 +1,35 @@
+/* -*- Mode: C++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-*/
+/* vim: set ts=2 sw=2 et tw=79: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Minimal stand-in for EmbedLiteApp, only what MessagePumpQt needs.
+
+#ifndef stub_EmbedLiteApp_h
+#define stub_EmbedLiteApp_h
+
+#include "mozilla/embedlite/EmbedLiteMessagePump.h"
+
+namespace mozilla {
+namespace embedlite {
+
+class EmbedLiteApp
+{
+public:
+  typedef EmbedLiteMessagePump* (*PumpFactory)(EmbedLiteMessagePumpListener* aListener);
+
+  explicit EmbedLiteApp(PumpFactory aFactory = 0) : mFactory(aFactory) {}
+
+  EmbedLiteMessagePump* CreateEmbedLiteMessagePump(EmbedLiteMessagePumpListener* aListener)
+  {
+    return mFactory ? mFactory(aListener) : new EmbedLiteMessagePump(aListener);
+  }
+
+private:
+  PumpFactory mFactory;
+};
+
+}}
+
+#endif /* stub_EmbedLiteApp_h */
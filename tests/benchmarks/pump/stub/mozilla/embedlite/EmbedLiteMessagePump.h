@@ -0,0 +1,45 @@
+/* -*- Mode: C++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-*/
+/* vim: set ts=2 sw=2 et tw=79: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Minimal stand-in for the EmbedLite pump interface, used to drive
+// MessagePumpQt from benchmarks without Gecko.
+
+#ifndef stub_EmbedLiteMessagePump_h
+#define stub_EmbedLiteMessagePump_h
+
+namespace mozilla {
+namespace embedlite {
+
+class EmbedLiteMessagePumpListener
+{
+public:
+  virtual ~EmbedLiteMessagePumpListener() {}
+  virtual void Run(void* aDelegate) = 0;
+  virtual void Quit() = 0;
+  virtual void ScheduleWork() = 0;
+  virtual void ScheduleWorkLocal() = 0;
+  virtual void ScheduleDelayedWork(const int aDelay) = 0;
+};
+
+class EmbedLiteMessagePump
+{
+public:
+  explicit EmbedLiteMessagePump(EmbedLiteMessagePumpListener* aListener) : mListener(aListener) {}
+  virtual ~EmbedLiteMessagePump() {}
+
+  virtual bool DoWork(void* aDelegate) { return false; }
+  virtual bool DoDelayedWork(void* aDelegate) { return false; }
+  virtual bool DoIdleWork(void* aDelegate) { return false; }
+
+  EmbedLiteMessagePumpListener* Listener() const { return mListener; }
+
+private:
+  EmbedLiteMessagePumpListener* mListener;
+};
+
+}}
+
+#endif /* stub_EmbedLiteMessagePump_h */
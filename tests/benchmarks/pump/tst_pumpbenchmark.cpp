@@ -0,0 +1,370 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <QtTest/QtTest>
+#include <QElapsedTimer>
+#include <QTouchEvent>
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#include "qmessagepump.h"
+#include "mozilla/embedlite/EmbedLiteApp.h"
+
+using namespace mozilla::embedlite;
+
+// Live heap blocks, tracked by the replacement operator new/delete below
+static QAtomicInt sLiveAllocations;
+
+void* operator new(std::size_t aSize)
+{
+    void* block = malloc(aSize ? aSize : 1);
+    if (!block) {
+        throw std::bad_alloc();
+    }
+    sLiveAllocations.ref();
+    return block;
+}
+
+void operator delete(void* aBlock) noexcept
+{
+    if (aBlock) {
+        sLiveAllocations.deref();
+        free(aBlock);
+    }
+}
+
+/*
+ * Synthetic Gecko loop: every DoWork() call busy-waits for workCost
+ * microseconds and reports more work until pendingWork runs out.
+ * Call times are taken from clock.
+ */
+class SyntheticPump : public EmbedLiteMessagePump
+{
+public:
+    explicit SyntheticPump(EmbedLiteMessagePumpListener* aListener)
+        : EmbedLiteMessagePump(aListener)
+        , pendingWork(0)
+        , workCost(0)
+        , doWorkCalls(0)
+        , doDelayedWorkCalls(0)
+        , lastDoWorkAt(0)
+        , lastDoDelayedWorkAt(0)
+    {
+        clock.start();
+    }
+
+    virtual bool DoWork(void* aDelegate)
+    {
+        doWorkCalls++;
+        lastDoWorkAt = clock.nsecsElapsed();
+        if (pendingWork <= 0) {
+            return false;
+        }
+        if (workCost > 0) {
+            QElapsedTimer spin;
+            spin.start();
+            while (spin.nsecsElapsed() < workCost * 1000LL) {
+            }
+        }
+        return --pendingWork > 0;
+    }
+
+    virtual bool DoDelayedWork(void* aDelegate)
+    {
+        doDelayedWorkCalls++;
+        lastDoDelayedWorkAt = clock.nsecsElapsed();
+        return false;
+    }
+
+    QElapsedTimer clock;
+    int pendingWork;
+    int workCost;
+    int doWorkCalls;
+    int doDelayedWorkCalls;
+    qint64 lastDoWorkAt;
+    qint64 lastDoDelayedWorkAt;
+};
+
+static qreal
+median(QVector<qint64> aSamples)
+{
+    std::sort(aSamples.begin(), aSamples.end());
+    return aSamples.at(aSamples.size() / 2);
+}
+
+static SyntheticPump* sLastPump = 0;
+
+static EmbedLiteMessagePump*
+createSyntheticPump(EmbedLiteMessagePumpListener* aListener)
+{
+    sLastPump = new SyntheticPump(aListener);
+    return sLastPump;
+}
+
+/*
+ * Records how long a posted touch update waited in the queue.
+ */
+class InputProbe : public QObject
+{
+public:
+    InputProbe() : received(false), latency(0) {}
+
+    virtual bool event(QEvent* aEvent)
+    {
+        if (aEvent->type() == QEvent::TouchUpdate) {
+            latency = clock.nsecsElapsed();
+            received = true;
+            return true;
+        }
+        return QObject::event(aEvent);
+    }
+
+    QElapsedTimer clock;
+    bool received;
+    qint64 latency;
+};
+
+class tst_PumpBenchmark : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void scheduleLatency_data();
+    void scheduleLatency();
+    void delayedWorkAccuracy_data();
+    void delayedWorkAccuracy();
+    void throughput_data();
+    void throughput();
+
+    void inputLatency_data();
+    void inputLatency();
+    void nestedRunLoops();
+
+private:
+    void createPump(MessagePumpQt::Backend aBackend);
+
+    EmbedLiteApp* mApp;
+    MessagePumpQt* mPump;
+    int mDelegate;
+};
+
+void tst_PumpBenchmark::init()
+{
+    mApp = new EmbedLiteApp(createSyntheticPump);
+    mPump = 0;
+    createPump(MessagePumpQt::PostEventBackend);
+}
+
+void tst_PumpBenchmark::cleanup()
+{
+    mPump->Quit();
+    delete mPump;
+    delete mApp;
+    sLastPump = 0;
+}
+
+void tst_PumpBenchmark::createPump(MessagePumpQt::Backend aBackend)
+{
+    if (mPump) {
+        mPump->Quit();
+        delete mPump;
+    }
+    mPump = new MessagePumpQt(mApp, aBackend);
+    // Idle work is not part of these measurements
+    mPump->setIdleFrameWindow(NULL);
+    mPump->Run(&mDelegate);
+    QCoreApplication::processEvents();
+}
+
+void tst_PumpBenchmark::scheduleLatency_data()
+{
+    QTest::addColumn<int>("backend");
+    QTest::newRow("postevent") << int(MessagePumpQt::PostEventBackend);
+    QTest::newRow("eventfd") << int(MessagePumpQt::EventFdBackend);
+}
+
+// Median time from ScheduleWork() on an idle pump to the DoWork() call
+void tst_PumpBenchmark::scheduleLatency()
+{
+    QFETCH(int, backend);
+    const int samples = 1000;
+    createPump(MessagePumpQt::Backend(backend));
+    if (mPump->backend() != backend) {
+        QSKIP("backend not available on this platform");
+    }
+
+    QVector<qint64> latencies;
+    for (int i = 0; i < samples; ++i) {
+        int calls = sLastPump->doWorkCalls;
+        qint64 scheduledAt = sLastPump->clock.nsecsElapsed();
+        mPump->ScheduleWork();
+        while (sLastPump->doWorkCalls == calls) {
+            QCoreApplication::processEvents();
+        }
+        latencies.append(sLastPump->lastDoWorkAt - scheduledAt);
+    }
+    QTest::setBenchmarkResult(median(latencies) / 1000000.0, QTest::WalltimeMilliseconds);
+}
+
+void tst_PumpBenchmark::delayedWorkAccuracy_data()
+{
+    QTest::addColumn<int>("backend");
+    QTest::addColumn<int>("delay");
+    QTest::newRow("postevent-1ms") << int(MessagePumpQt::PostEventBackend) << 1;
+    QTest::newRow("postevent-16ms") << int(MessagePumpQt::PostEventBackend) << 16;
+    QTest::newRow("postevent-100ms") << int(MessagePumpQt::PostEventBackend) << 100;
+    QTest::newRow("eventfd-1ms") << int(MessagePumpQt::EventFdBackend) << 1;
+    QTest::newRow("eventfd-16ms") << int(MessagePumpQt::EventFdBackend) << 16;
+    QTest::newRow("eventfd-100ms") << int(MessagePumpQt::EventFdBackend) << 100;
+}
+
+// Median lateness of delayed work against the requested delay
+void tst_PumpBenchmark::delayedWorkAccuracy()
+{
+    QFETCH(int, backend);
+    QFETCH(int, delay);
+    const int samples = 20;
+    createPump(MessagePumpQt::Backend(backend));
+    if (mPump->backend() != backend) {
+        QSKIP("backend not available on this platform");
+    }
+
+    QVector<qint64> lateness;
+    for (int i = 0; i < samples; ++i) {
+        int calls = sLastPump->doDelayedWorkCalls;
+        qint64 dueAt = sLastPump->clock.nsecsElapsed() + delay * Q_INT64_C(1000000);
+        mPump->ScheduleDelayedWork(delay);
+        while (sLastPump->doDelayedWorkCalls == calls) {
+            QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+        }
+        // Nothing more is due, stop the pump from re-arming its timer
+        mPump->ScheduleDelayedWork(-1);
+        lateness.append(sLastPump->lastDoDelayedWorkAt - dueAt);
+    }
+    QTest::setBenchmarkResult(median(lateness) / 1000000.0, QTest::WalltimeMilliseconds);
+}
+
+void tst_PumpBenchmark::throughput_data()
+{
+    QTest::addColumn<int>("backend");
+    QTest::addColumn<int>("budget");
+    QTest::newRow("postevent-unbatched") << int(MessagePumpQt::PostEventBackend) << 0;
+    QTest::newRow("postevent-batched-4ms") << int(MessagePumpQt::PostEventBackend) << 4;
+    QTest::newRow("eventfd-unbatched") << int(MessagePumpQt::EventFdBackend) << 0;
+    QTest::newRow("eventfd-batched-4ms") << int(MessagePumpQt::EventFdBackend) << 4;
+}
+
+// Tasks per second (reported as events) for a burst of trivial tasks
+void tst_PumpBenchmark::throughput()
+{
+    QFETCH(int, backend);
+    QFETCH(int, budget);
+    const int tasks = 100000;
+    createPump(MessagePumpQt::Backend(backend));
+    if (mPump->backend() != backend) {
+        QSKIP("backend not available on this platform");
+    }
+    mPump->setDispatchBudget(budget);
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+    sLastPump->pendingWork = tasks;
+    mPump->ScheduleWork();
+    while (sLastPump->pendingWork > 0) {
+        QCoreApplication::processEvents();
+    }
+    qint64 nsecs = qMax(elapsed.nsecsElapsed(), Q_INT64_C(1));
+    QTest::setBenchmarkResult(tasks * 1000000000.0 / nsecs, QTest::Events);
+}
+
+void tst_PumpBenchmark::inputLatency_data()
+{
+    QTest::addColumn<bool>("prioritized");
+    QTest::newRow("fifo") << false;
+    QTest::newRow("prioritized") << true;
+}
+
+// Median time from posting a touch update to its delivery while the pump
+// is saturated with 1 ms Gecko tasks batched in 16 ms dispatches.
+void tst_PumpBenchmark::inputLatency()
+{
+    QFETCH(bool, prioritized);
+    const int samples = 50;
+
+    mPump->setDispatchBudget(16);
+    mPump->setPrioritizeInput(prioritized);
+    sLastPump->workCost = 1000;
+    sLastPump->pendingWork = 1 << 30;
+
+    InputProbe probe;
+    QTouchEvent touchBegin(QEvent::TouchBegin);
+    QCoreApplication::sendEvent(&probe, &touchBegin);
+
+    QVector<qint64> latencies;
+    mPump->ScheduleWork();
+    for (int i = 0; i < samples; ++i) {
+        // Let a batch get under way before the input arrives
+        QCoreApplication::processEvents();
+        probe.received = false;
+        probe.clock.start();
+        QCoreApplication::postEvent(&probe, new QTouchEvent(QEvent::TouchUpdate));
+        while (!probe.received) {
+            QCoreApplication::processEvents();
+        }
+        latencies.append(probe.latency);
+    }
+
+    QTouchEvent touchEnd(QEvent::TouchEnd);
+    QCoreApplication::sendEvent(&probe, &touchEnd);
+    sLastPump->pendingWork = 0;
+    mPump->setPrioritizeInput(false);
+
+    QTest::setBenchmarkResult(median(latencies) / 1000000.0, QTest::WalltimeMilliseconds);
+}
+
+// Opens and closes thousands of nested loops, 8 levels deep, the way
+// modal prompts do. Run()/Quit() must not grow the heap.
+void tst_PumpBenchmark::nestedRunLoops()
+{
+    const int loops = 1000;
+    const int depth = 8;
+    int delegates[depth];
+
+    QCoreApplication::processEvents();
+    int liveBefore = sLiveAllocations.load();
+    for (int i = 0; i < loops; ++i) {
+        for (int d = 0; d < depth; ++d) {
+            mPump->Run(&delegates[d]);
+        }
+        for (int d = 0; d < depth; ++d) {
+            mPump->Quit();
+        }
+    }
+    // Quit() pokes the enclosing loop, let that poke be delivered and freed
+    QCoreApplication::processEvents();
+    QCOMPARE(sLiveAllocations.load(), liveBefore);
+    QCOMPARE(mPump->runDepth(), 1);
+
+    QBENCHMARK {
+        for (int i = 0; i < loops; ++i) {
+            for (int d = 0; d < depth; ++d) {
+                mPump->Run(&delegates[d]);
+            }
+            for (int d = 0; d < depth; ++d) {
+                mPump->Quit();
+            }
+        }
+    }
+    QCOMPARE(mPump->runDepth(), 1);
+}
+
+QTEST_MAIN(tst_PumpBenchmark)
+
+#include "tst_pumpbenchmark.moc"
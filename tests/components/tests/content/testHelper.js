@@ -45,6 +45,10 @@ TestHelper.prototype = {
     // Services.obs.addObserver(this, "before-first-paint", true);
     addMessageListener("embedtest:getelementprop", this);
     addMessageListener("embedtest:getelementinner", this);
+    addMessageListener("embedtest:batchecho", this);
+    // MessageBatch.js only wraps addMessageListener(), batched messages
+    // reach weak listeners by being sent again unbatched
+    addWeakMessageListener("embedtest:weakecho", this);
   },
 
   observe: function(aSubject, aTopic, data) {
@@ -64,6 +68,11 @@ TestHelper.prototype = {
         sendAsyncMessage("testembed:elementinnervalue", {value: element.innerHTML});
         break;
       }
+      case "embedtest:batchecho":
+      case "embedtest:weakecho": {
+        sendAsyncMessage("testembed:batchecho", {name: aMessage.name, value: aMessage.json.value});
+        break;
+      }
       default: {
         break;
       }
@@ -1,10 +1,11 @@
 TEMPLATE = subdirs
 
-SUBDIRS = qmlmoztestrunner
+SUBDIRS = qmlmoztestrunner benchmarks auto/unit
 
 OTHER_FILES += auto/* auto/scripts/*
 
-auto.files = auto/*
+# C++ unit tests under auto/unit install their binaries only
+auto.files = auto/desktop-qt5 auto/mer-qt4 auto/mer-qt5 auto/shared auto/run-tests.sh
 auto.path = /opt/tests/qtmozembed/auto
 
 components.files = components/*